@@ -0,0 +1,275 @@
+#define _DEFAULT_SOURCE
+#include "ring.h"
+#include "serial.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// Bytes held between the reader and the writer, minutes of a 115200 baud link
+#define CAPTURERING (16 << 20)
+// Most bytes taken from the device in one read
+#define CAPTUREREAD (64 << 10)
+// Longest line kept whole, longer ones are cut here and counted
+#define CAPTURELINE 4096
+// Room for a record: the timestamp, its comma, the line and the newline
+#define CAPTURERECORD (CAPTURELINE + 32)
+// How long the reader waits for room when the ring is full, and the writer for data when
+// it is empty, in nanoseconds
+#define CAPTUREWAIT 100000
+#define CAPTUREIDLE 1000000
+#define CAPTUREBAUD 9600
+
+// Shared between the reader and the writer thread
+typedef struct capture_s {
+	ring_t ring;
+	int output;
+	atomic_int done;
+	int failed;
+} capture_t;
+
+// Counts of what happened to the input, printed at the end
+typedef struct capture_stats_s {
+	unsigned long lines;
+	unsigned long long bytes;
+	unsigned long cut;
+	unsigned long waits;
+} capture_stats_t;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stopCapture(int signal);
+static void closeCapture(capture_t *capture, int device);
+static void pushRecord(capture_t *capture, const char *line, size_t length, long long timestamp, int stamped, capture_stats_t *stats);
+static void *runWriter(void *arg);
+static long long nowUs(void);
+
+/*
+Captures the lines a sweep sketch prints on a serial port to a file, replacing the
+Data_Processing_Code Processing sketch. The main thread reads the device and puts each line,
+stamped with the time it arrived, into a lock free ring; a writer thread empties the ring to
+the output in large batches, so a slow disk never holds up the port. It runs until the
+device hangs up, the line count is reached or it gets SIGINT or SIGTERM, and always writes
+out everything it read before exiting.
+usage: capture [-b baud] [-n lines] [-T] [-o output] <device>
+  -b  line speed when the device is a serial port, default CAPTUREBAUD
+  -n  stop after this many lines, default no limit
+  -T  write the lines as they came, without the timestamp
+  -o  the file to append records to, default standard output
+Each record is <microseconds since the epoch>,<line>.
+*/
+int main(int argc, char *argv[]) {
+	capture_t capture;
+	capture_stats_t stats;
+	pthread_t writer;
+	struct sigaction action;
+	sigset_t blocked;
+	sigset_t previous;
+	static char buffer[CAPTUREREAD];
+	char line[CAPTURELINE];
+	const char *output = NULL;
+	unsigned long maxLines = 0;
+	long baud = CAPTUREBAUD;
+	long long timestamp;
+	size_t length = 0;
+	ssize_t got;
+	ssize_t i;
+	int stamped = 1;
+	int device;
+	int option;
+
+	while ((option = getopt(argc, argv, "b:n:To:")) != -1) {
+		if (option == 'b')
+			baud = atol(optarg);
+		else if (option == 'n')
+			maxLines = strtoul(optarg, NULL, 10);
+		else if (option == 'T')
+			stamped = 0;
+		else if (option == 'o')
+			output = optarg;
+		else
+			optind = argc + 1;
+	}
+	if (optind != argc - 1) {
+		fprintf(stderr, "usage: %s [-b baud] [-n lines] [-T] [-o output] <device>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	device = openSerial(argv[optind], baud);
+	if (device < 0) {
+		fprintf(stderr, "Could not open %s\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+	capture.output = output == NULL ? STDOUT_FILENO : open(output, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (capture.output < 0) {
+		fprintf(stderr, "Could not open %s\n", output);
+		close(device);
+		return EXIT_FAILURE;
+	}
+	if (initRing(&capture.ring, CAPTURERING) != 0) {
+		fprintf(stderr, "Could not allocate the ring\n");
+		closeCapture(&capture, device);
+		return EXIT_FAILURE;
+	}
+	atomic_init(&capture.done, 0);
+	capture.failed = 0;
+	memset(&stats, 0, sizeof(stats));
+
+	// No SA_RESTART, so a signal breaks a blocked read and the loop sees stopping. The
+	// handlers go in first, and the writer starts with both signals blocked so they always
+	// reach this thread's read rather than the writer's sleep.
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = stopCapture;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGINT);
+	sigaddset(&blocked, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+	if (pthread_create(&writer, NULL, runWriter, &capture) != 0) {
+		fprintf(stderr, "Could not start the writer\n");
+		freeRing(&capture.ring);
+		closeCapture(&capture, device);
+		return EXIT_FAILURE;
+	}
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+	while (!stopping && (maxLines == 0 || stats.lines < maxLines)) {
+		got = read(device, buffer, sizeof(buffer));
+		if (got < 0 && errno == EINTR)
+			continue;
+		// A pty whose other end closed gives EIO, a serial port that hung up gives 0
+		if (got <= 0)
+			break;
+		timestamp = nowUs();
+		stats.bytes += got;
+		for (i = 0; i < got && (maxLines == 0 || stats.lines < maxLines); i++) {
+			if (buffer[i] == '\n') {
+				if (length > 0)
+					pushRecord(&capture, line, length, timestamp, stamped, &stats);
+				length = 0;
+			}
+			else if (buffer[i] == '\r') {
+				continue;
+			}
+			else if (length < CAPTURELINE) {
+				line[length++] = buffer[i];
+			}
+			else if (length == CAPTURELINE) {
+				// Keep the start of an over long line and count it once
+				stats.cut++;
+				length++;
+			}
+		}
+	}
+	// A last line without its newline is still a line
+	if (length > 0 && (maxLines == 0 || stats.lines < maxLines))
+		pushRecord(&capture, line, length, nowUs(), stamped, &stats);
+
+	atomic_store(&capture.done, 1);
+	pthread_join(writer, NULL);
+	freeRing(&capture.ring);
+	closeCapture(&capture, device);
+	fprintf(stderr, "%lu lines, %llu bytes, %lu cut, %lu waits for the writer\n", stats.lines, stats.bytes, stats.cut, stats.waits);
+	return capture.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+Asks the capture to finish, from a signal handler
+@param signal - the signal received
+*/
+static void stopCapture(int signal) {
+	(void)signal;
+	stopping = 1;
+}
+
+/*
+Closes the device and the output, unless that is standard output
+@param capture - the capture state
+@param device - the device
+*/
+static void closeCapture(capture_t *capture, int device) {
+	close(device);
+	if (capture->output != STDOUT_FILENO)
+		close(capture->output);
+}
+
+/*
+Formats one record and puts it in the ring, waiting for the writer if the ring is full so no
+line is ever dropped
+@param capture - the capture state
+@param line - the line without its newline
+@param length - its length, more than CAPTURELINE if it was cut
+@param timestamp - when it arrived, in microseconds
+@param stamped - whether to put the timestamp in front
+@param stats - counts to update
+*/
+static void pushRecord(capture_t *capture, const char *line, size_t length, long long timestamp, int stamped, capture_stats_t *stats) {
+	char record[CAPTURERECORD];
+	size_t size = 0;
+
+	if (length > CAPTURELINE)
+		length = CAPTURELINE;
+	if (stamped)
+		size = sprintf(record, "%lld,", timestamp);
+	memcpy(record + size, line, length);
+	size += length;
+	record[size++] = '\n';
+	while (putRing(&capture->ring, record, size) != 0) {
+		struct timespec wait = { 0, CAPTUREWAIT };
+		stats->waits++;
+		nanosleep(&wait, NULL);
+	}
+	stats->lines++;
+}
+
+/*
+Empties the ring to the output until the reader is done and nothing is left. Everything
+waiting is written in one go, so the batches grow as the input speeds up.
+@param arg - the capture_t to work on
+@return - NULL
+*/
+static void *runWriter(void *arg) {
+	capture_t *capture = arg;
+	struct timespec idle = { 0, CAPTUREIDLE };
+	const char *data;
+	size_t waiting;
+	ssize_t written;
+	int done;
+
+	for (;;) {
+		// Read done before peeking, so data put in before it was set is never missed
+		done = atomic_load(&capture->done);
+		waiting = peekRing(&capture->ring, &data);
+		if (waiting == 0) {
+			if (done)
+				break;
+			nanosleep(&idle, NULL);
+			continue;
+		}
+		written = write(capture->output, data, waiting);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			// Keep draining so the reader never stalls, but report the loss at the end
+			capture->failed = 1;
+			written = waiting;
+		}
+		takeRing(&capture->ring, written);
+	}
+	return NULL;
+}
+
+/*
+Returns the wall clock time in microseconds since the epoch
+*/
+static long long nowUs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,205 @@
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+
+// How often the feed checks whether the reader has taken everything, in nanoseconds
+#define FEEDPOLL 1000000
+// Longest the feed waits for the reader to catch up before hanging up anyway, in polls
+#define FEEDPATIENCE 5000
+
+static int openPty(int *master, int *slave, char *name, size_t size);
+static int feedLine(int master, const char *line, size_t length, pid_t child);
+static void waitDrained(int slave, pid_t child);
+static int hasExited(pid_t child);
+
+/*
+Stands in for the sweep rig on a pseudo terminal so capture can be tested without hardware.
+It opens a pty, starts the command with the pty's path as its last argument, writes the
+lines of the file to the pty at the given rate, waits for the command to read them all and
+then hangs up, as unplugging the rig would. It stops early if the command exits.
+usage: pty_feed [-r lines per second] [-c copies] <file> <command> [args...]
+  -r  lines written per second, default 0 for as fast as the pty takes them
+  -c  write the file this many times over, default 1
+Blank lines in the file are skipped. The exit status is the command's.
+*/
+int main(int argc, char *argv[]) {
+	struct timespec wait;
+	char name[256];
+	char line[4096];
+	char **command;
+	double rate = 0;
+	long copies = 1;
+	long copy;
+	long sent = 0;
+	size_t length;
+	pid_t child;
+	FILE *fp;
+	int master;
+	int slave;
+	int status = 0;
+	int exited = 0;
+	int option;
+	int i;
+
+	// Options stop at the file, so the command keeps its own
+	while ((option = getopt(argc, argv, "+r:c:")) != -1) {
+		if (option == 'r')
+			rate = atof(optarg);
+		else if (option == 'c')
+			copies = atol(optarg);
+		else
+			optind = argc + 1;
+	}
+	if (optind + 2 > argc) {
+		fprintf(stderr, "usage: %s [-r lines per second] [-c copies] <file> <command> [args...]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	fp = fopen(argv[optind], "r");
+	if (fp == NULL || openPty(&master, &slave, name, sizeof(name)) != 0) {
+		fprintf(stderr, "Could not set up %s on a pty\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	command = malloc((argc - optind + 1) * sizeof(char *));
+	if (command == NULL)
+		return EXIT_FAILURE;
+	for (i = optind + 1; i < argc; i++)
+		command[i - optind - 1] = argv[i];
+	command[argc - optind - 1] = name;
+	command[argc - optind] = NULL;
+	child = fork();
+	if (child == 0) {
+		close(master);
+		close(slave);
+		execvp(command[0], command);
+		_exit(127);
+	}
+	free(command);
+	if (child < 0)
+		return EXIT_FAILURE;
+
+	for (copy = 0; copy < copies && !exited; copy++) {
+		rewind(fp);
+		while (fgets(line, sizeof(line), fp) != NULL) {
+			length = strlen(line);
+			if (line[0] == '\n' || (line[0] == '\r' && line[1] == '\n'))
+				continue;
+			// A paced feed checks every line, a full speed one only when the pty is full
+			if ((rate > 0 && hasExited(child)) || feedLine(master, line, length, child) != 0) {
+				exited = 1;
+				break;
+			}
+			sent++;
+			if (rate > 0) {
+				// Below one line a second the wait runs past a whole second, which
+				// tv_nsec alone can't hold
+				wait.tv_sec = (time_t)(1 / rate);
+				wait.tv_nsec = (1 / rate - wait.tv_sec) * 1e9;
+				nanosleep(&wait, NULL);
+			}
+		}
+	}
+	fclose(fp);
+	if (!exited)
+		waitDrained(slave, child);
+	close(master);
+	close(slave);
+	waitpid(child, &status, 0);
+	fprintf(stderr, "%ld lines fed\n", sent);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+}
+
+/*
+Opens a new pty in raw mode, so the lines reach the reader as written
+@param master - receives the end the feed writes to
+@param slave - receives the end the command reads from, held open so the pty stays up
+@param name - receives the path of the slave end
+@param size - room in name
+@return - 0 on success, -1 on failure
+*/
+static int openPty(int *master, int *slave, char *name, size_t size) {
+	struct termios settings;
+
+	*master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (*master < 0 || grantpt(*master) != 0 || unlockpt(*master) != 0 || ptsname(*master) == NULL)
+		return -1;
+	snprintf(name, size, "%s", ptsname(*master));
+	*slave = open(name, O_RDWR | O_NOCTTY);
+	if (*slave < 0 || tcgetattr(*slave, &settings) != 0)
+		return -1;
+	cfmakeraw(&settings);
+	// Never block on a full pty, so the feed notices when the command has gone
+	if (fcntl(*master, F_SETFL, fcntl(*master, F_GETFL) | O_NONBLOCK) != 0)
+		return -1;
+	return tcsetattr(*slave, TCSANOW, &settings);
+}
+
+/*
+Writes one line to the pty, waiting for room as long as the command is still running
+@param master - the end the feed writes to
+@param line - the line
+@param length - its length
+@param child - the command
+@return - 0 once written, -1 if the command exited or the pty failed
+*/
+static int feedLine(int master, const char *line, size_t length, pid_t child) {
+	struct pollfd room = { master, POLLOUT, 0 };
+	ssize_t written;
+
+	while (length > 0) {
+		written = write(master, line, length);
+		if (written > 0) {
+			line += written;
+			length -= written;
+			continue;
+		}
+		if (written < 0 && errno != EAGAIN && errno != EINTR)
+			return -1;
+		if (hasExited(child))
+			return -1;
+		poll(&room, 1, FEEDPOLL / 1000000);
+	}
+	return 0;
+}
+
+/*
+Waits until the reader has taken everything written to the pty, or gives up after
+FEEDPATIENCE polls or when the command exits
+@param slave - the reader's end
+@param child - the command
+*/
+static void waitDrained(int slave, pid_t child) {
+	struct timespec poll = { 0, FEEDPOLL };
+	int queued = 1;
+	int polls;
+
+	for (polls = 0; polls < FEEDPATIENCE; polls++) {
+		if (ioctl(slave, FIONREAD, &queued) != 0 || queued == 0 || hasExited(child))
+			break;
+		nanosleep(&poll, NULL);
+	}
+	// Bytes can still sit between the two ends for a moment after the count reads zero
+	nanosleep(&poll, NULL);
+}
+
+/*
+Tells whether the command has exited, leaving it to be reaped with its status later
+@param child - the command
+@return - 1 if it has exited, otherwise 0
+*/
+static int hasExited(pid_t child) {
+	siginfo_t info;
+
+	info.si_pid = 0;
+	return waitid(P_PID, child, &info, WEXITED | WNOHANG | WNOWAIT) != 0 || info.si_pid != 0;
+}
@@ -0,0 +1,84 @@
+#include "ring.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+Sets up an empty ring
+@param ring - the ring to set up
+@param size - bytes it holds, rounded up to a power of two
+@return - 0 on success, -1 if out of memory
+*/
+int initRing(ring_t *ring, size_t size) {
+	size_t rounded = 1;
+
+	while (rounded < size)
+		rounded <<= 1;
+	ring->data = malloc(rounded);
+	if (ring->data == NULL)
+		return -1;
+	ring->size = rounded;
+	ring->mask = rounded - 1;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	return 0;
+}
+
+/*
+Releases the buffer of a ring
+@param ring - the ring to release
+*/
+void freeRing(ring_t *ring) {
+	free(ring->data);
+	ring->data = NULL;
+}
+
+/*
+Adds bytes to the ring, all of them or none. Producer side only.
+@param ring - the ring
+@param data - the bytes to add
+@param length - how many
+@return - 0 on success, -1 if there is not room for all of them yet
+*/
+int putRing(ring_t *ring, const char *data, size_t length) {
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	size_t start = head & ring->mask;
+	size_t first;
+
+	if (ring->size - (head - tail) < length)
+		return -1;
+	// Copy up to the end of the buffer, then whatever is left from its start
+	first = ring->size - start < length ? ring->size - start : length;
+	memcpy(ring->data + start, data, first);
+	memcpy(ring->data, data + first, length - first);
+	atomic_store_explicit(&ring->head, head + length, memory_order_release);
+	return 0;
+}
+
+/*
+Finds the bytes waiting in the ring that sit in one piece. Consumer side only.
+@param ring - the ring
+@param data - receives where they start
+@return - how many there are, 0 if the ring is empty. More may follow from the start of
+the buffer once these are taken.
+*/
+size_t peekRing(ring_t *ring, const char **data) {
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	size_t start = tail & ring->mask;
+	size_t waiting = head - tail;
+
+	*data = ring->data + start;
+	return ring->size - start < waiting ? ring->size - start : waiting;
+}
+
+/*
+Releases bytes the consumer is done with so the producer can reuse them
+@param ring - the ring
+@param length - how many bytes, no more than peekRing gave
+*/
+void takeRing(ring_t *ring, size_t length) {
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	atomic_store_explicit(&ring->tail, tail + length, memory_order_release);
+}
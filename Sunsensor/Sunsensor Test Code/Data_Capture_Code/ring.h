@@ -0,0 +1,31 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+// Keeps the two positions on separate cache lines so the threads don't fight over one
+#define RINGLINE 64
+
+// Byte ring between exactly one producer and one consumer. Only the producer moves head
+// and only the consumer moves tail, so neither side takes a lock. Both positions count
+// bytes ever written or read and wrap into data through mask, size being a power of two.
+typedef struct ring_s {
+	char *data;
+	size_t size;
+	size_t mask;
+	_Alignas(RINGLINE) atomic_size_t head;
+	_Alignas(RINGLINE) atomic_size_t tail;
+} ring_t;
+
+int initRing(ring_t *ring, size_t size);
+
+void freeRing(ring_t *ring);
+
+int putRing(ring_t *ring, const char *data, size_t length);
+
+size_t peekRing(ring_t *ring, const char **data);
+
+void takeRing(ring_t *ring, size_t length);
+
+#endif
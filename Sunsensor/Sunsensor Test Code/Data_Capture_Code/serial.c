@@ -0,0 +1,57 @@
+#define _DEFAULT_SOURCE
+#include "serial.h"
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+static speed_t getBaudSpeed(long baud);
+
+/*
+Opens the device to read, putting it in raw mode at the given speed if it is a terminal
+@param device - the path of the serial port or pty
+@param baud - the line speed
+@return - the file descriptor, or -1 on failure
+*/
+int openSerial(const char *device, long baud) {
+	struct termios settings;
+	speed_t speed = getBaudSpeed(baud);
+	int fd = open(device, O_RDONLY | O_NOCTTY);
+
+	if (fd < 0)
+		return -1;
+	if (isatty(fd)) {
+		if (tcgetattr(fd, &settings) != 0 || speed == B0) {
+			close(fd);
+			return -1;
+		}
+		cfmakeraw(&settings);
+		settings.c_cflag |= CLOCAL | CREAD;
+		// Block until at least one byte is there, then take whatever has arrived
+		settings.c_cc[VMIN] = 1;
+		settings.c_cc[VTIME] = 0;
+		cfsetispeed(&settings, speed);
+		cfsetospeed(&settings, speed);
+		if (tcsetattr(fd, TCSANOW, &settings) != 0) {
+			close(fd);
+			return -1;
+		}
+	}
+	return fd;
+}
+
+/*
+Maps a line speed to its termios constant
+@param baud - the line speed
+@return - the constant, or B0 if the speed is not supported
+*/
+static speed_t getBaudSpeed(long baud) {
+	static const long bauds[] = { 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600 };
+	static const speed_t speeds[] = { B9600, B19200, B38400, B57600, B115200, B230400, B460800, B921600 };
+	size_t i;
+
+	for (i = 0; i < sizeof(bauds) / sizeof(bauds[0]); i++) {
+		if (bauds[i] == baud)
+			return speeds[i];
+	}
+	return B0;
+}
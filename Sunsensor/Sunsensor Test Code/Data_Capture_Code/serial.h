@@ -0,0 +1,6 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+int openSerial(const char *device, long baud);
+
+#endif
@@ -0,0 +1,119 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "wire_decoder.h"
+extern "C" {
+#include "serial.h"
+}
+
+// Most bytes taken from the device in one read
+#define DECODEREAD (64 << 10)
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stopDecode(int signal);
+static long long nowUs(void);
+
+/*
+Decodes the binary frames of a sketch built with BINARY_OUTPUT into the text lines capture
+writes, so photolog and build_table read them as before.
+usage: wire_decode [-b baud] [-n frames] [-T] <device|file|->
+  -b  line speed when reading a serial port, default WIRE_BAUD
+  -n  stop after this many frames, default no limit
+  -T  leave out the arrival timestamp in front of each line
+Each line is <microseconds since the epoch>,sens,plat,v1,v2,v3,v4, with the raw ADC counts.
+Frames with a bad CRC, skipped bytes and frames lost by sequence number are counted at the end.
+*/
+int main(int argc, char *argv[])
+{
+	static uint8_t buffer[DECODEREAD];
+	std::vector<WireReading> readings;
+	WireDecoder decoder;
+	struct sigaction action;
+	unsigned long maxFrames = 0;
+	unsigned long written = 0;
+	long baud = WIRE_BAUD;
+	long long timestamp;
+	bool stamped = true;
+	ssize_t got;
+	size_t i;
+	int device;
+	int option;
+
+	while ((option = getopt(argc, argv, "b:n:T")) != -1)
+	{
+		if (option == 'b')
+			baud = atol(optarg);
+		else if (option == 'n')
+			maxFrames = strtoul(optarg, NULL, 10);
+		else if (option == 'T')
+			stamped = false;
+		else
+			optind = argc + 1;
+	}
+	if (optind != argc - 1)
+	{
+		fprintf(stderr, "usage: %s [-b baud] [-n frames] [-T] <device|file|->\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	device = strcmp(argv[optind], "-") == 0 ? STDIN_FILENO : openSerial(argv[optind], baud);
+	if (device < 0)
+	{
+		fprintf(stderr, "Could not open %s\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = stopDecode;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	while (!stopping && (maxFrames == 0 || written < maxFrames))
+	{
+		got = read(device, buffer, sizeof(buffer));
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			break;
+		timestamp = nowUs();
+		readings.clear();
+		decoder.feed(buffer, got, readings);
+		for (i = 0; i < readings.size() && (maxFrames == 0 || written < maxFrames); i++, written++)
+		{
+			if (stamped)
+				printf("%lld,", timestamp);
+			printf("%d,%d,%u,%u,%u,%u,\n", readings[i].servo, readings[i].plat,
+				readings[i].counts[0], readings[i].counts[1], readings[i].counts[2], readings[i].counts[3]);
+		}
+	}
+	fflush(stdout);
+	if (device != STDIN_FILENO)
+		close(device);
+	fprintf(stderr, "%lu frames, %lu bad CRC, %lu bytes skipped, %lu lost\n", decoder.frames, decoder.badCrc, decoder.skipped, decoder.lost);
+	return EXIT_SUCCESS;
+}
+
+/*
+Asks the decoder to finish, from a signal handler
+@param signal - the signal received
+*/
+static void stopDecode(int signal)
+{
+	(void)signal;
+	stopping = 1;
+}
+
+/*
+Returns the wall clock time in microseconds since the epoch
+*/
+static long long nowUs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,101 @@
+#include <string.h>
+
+#include "wire_decoder.h"
+
+WireDecoder::WireDecoder()
+{
+	this->frames = 0;
+	this->badCrc = 0;
+	this->skipped = 0;
+	this->lost = 0;
+	this->held = 0;
+	this->lastSequence = -1;
+}
+
+/*
+Decodes as many frames as the bytes complete, keeping a partial frame for the next call
+@param data - the bytes received
+@param length - how many
+@param readings - the readings of the frames found are added to the end
+@return - the number of frames found
+*/
+size_t WireDecoder::feed(const uint8_t *data, size_t length, std::vector<WireReading> &readings)
+{
+	size_t found = readings.size();
+	size_t i = 0;
+
+	while (i < length)
+	{
+		// Whole frames straight from the input when in step, the usual case
+		if (this->held == 0 && length - i >= WIRE_FRAME && data[i] == WIRE_SYNC1 && data[i + 1] == WIRE_SYNC2)
+		{
+			if (this->takeFrame(data + i, readings))
+			{
+				i += WIRE_FRAME;
+			}
+			else
+			{
+				this->skipped++;
+				i++;
+			}
+			continue;
+		}
+		this->pending[this->held++] = data[i++];
+		while (this->held > 0)
+		{
+			if (this->pending[0] != WIRE_SYNC1 || (this->held > 1 && this->pending[1] != WIRE_SYNC2))
+			{
+				this->dropByte();
+				continue;
+			}
+			if (this->held < WIRE_FRAME)
+				break;
+			if (this->takeFrame(this->pending, readings))
+			{
+				this->held = 0;
+				break;
+			}
+			// Resync from the byte after this false start, its bytes may hold the real frame
+			this->dropByte();
+		}
+	}
+	return readings.size() - found;
+}
+
+/*
+Checks the CRC of a frame and decodes it if it is good
+@param frame - WIRE_FRAME bytes starting with the sync bytes
+@param readings - the reading is added to the end
+@return - whether the frame was good
+*/
+bool WireDecoder::takeFrame(const uint8_t *frame, std::vector<WireReading> &readings)
+{
+	WireReading reading;
+	int i;
+
+	if (getWireCrc(frame + 2, WIRE_BODY) != (frame[13] | frame[14] << 8))
+	{
+		this->badCrc++;
+		return false;
+	}
+	reading.sequence = frame[2];
+	reading.servo = (int8_t)frame[3];
+	reading.plat = (int8_t)frame[4];
+	for (i = 0; i < 4; i++)
+		reading.counts[i] = frame[5 + 2 * i] | frame[6 + 2 * i] << 8;
+	if (this->lastSequence >= 0)
+		this->lost += (uint8_t)(reading.sequence - this->lastSequence - 1);
+	this->lastSequence = reading.sequence;
+	this->frames++;
+	readings.push_back(reading);
+	return true;
+}
+
+/*
+Throws away the first byte held
+*/
+void WireDecoder::dropByte(void)
+{
+	memmove(this->pending, this->pending + 1, --this->held);
+	this->skipped++;
+}
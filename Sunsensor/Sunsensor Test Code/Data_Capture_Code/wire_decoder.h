@@ -0,0 +1,45 @@
+#ifndef WIRE_DECODER_H
+#define WIRE_DECODER_H
+
+#include <vector>
+#include "sweep_wire.h"
+
+// One reading taken out of a frame
+struct WireReading
+{
+	uint8_t sequence;
+	int servo;
+	int plat;
+	uint16_t counts[4];
+};
+
+/**
+ * Finds the frames of sweep_wire.h in a byte stream that may start mid frame, drop bytes or
+ * carry noise. Bytes that do not lead to a frame with a good CRC are skipped one at a time,
+ * so a frame is never lost to a false sync in front of it.
+ */
+class WireDecoder
+{
+	public:
+
+		unsigned long frames;
+		unsigned long badCrc;
+		unsigned long skipped;
+		unsigned long lost;
+
+		WireDecoder();
+
+		size_t feed(const uint8_t *data, size_t length, std::vector<WireReading> &readings);
+
+	private:
+
+		uint8_t pending[WIRE_FRAME];
+		size_t held;
+		int lastSequence;
+
+		bool takeFrame(const uint8_t *frame, std::vector<WireReading> &readings);
+
+		void dropByte(void);
+};
+
+#endif
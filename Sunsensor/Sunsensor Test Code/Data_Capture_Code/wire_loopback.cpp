@@ -0,0 +1,246 @@
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "wire_decoder.h"
+
+// Frames sent through the loopback
+#define LOOPFRAMES 100000
+// Every LOOPCORRUPT frames one has a bit flipped, every LOOPJUNK some noise comes before
+// one and every LOOPCUT one is sent short, as a reset of the sketch would
+#define LOOPCORRUPT 97
+#define LOOPJUNK 89
+#define LOOPCUT 1009
+// Bytes the writer gives the pty at once
+#define LOOPCHUNK 4096
+// Longest the reader waits for more bytes before failing, in milliseconds
+#define LOOPTIMEOUT 5000
+
+struct LoopStream
+{
+	std::vector<uint8_t> bytes;
+	std::vector<WireReading> expected;
+	unsigned long corrupted;
+	unsigned long cut;
+	int master;
+};
+
+static void buildStream(LoopStream &stream);
+static void *runWriter(void *arg);
+static bool sameReadings(const std::vector<WireReading> &got, const std::vector<WireReading> &expected);
+static double nowSeconds(void);
+
+/*
+Sends a sweep as binary frames through a raw pty, as the sketch sends them over its serial
+port, and checks that the decoder on the other end gets every good frame back exactly,
+rejects every damaged one and counts them as lost. The same bytes are then decoded one at a
+time, which must give the same result. Prints the decoding speed and the reading rates of
+the old and new link.
+*/
+int main(void)
+{
+	static uint8_t buffer[64 << 10];
+	std::vector<WireReading> got;
+	std::vector<WireReading> single;
+	WireDecoder decoder;
+	WireDecoder byteDecoder;
+	LoopStream stream;
+	struct termios settings;
+	struct pollfd ready;
+	pthread_t writer;
+	double start;
+	double elapsed;
+	ssize_t length;
+	size_t i;
+	int slave;
+	int failures = 0;
+
+	buildStream(stream);
+	stream.master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (stream.master < 0 || grantpt(stream.master) != 0 || unlockpt(stream.master) != 0 || ptsname(stream.master) == NULL)
+	{
+		fprintf(stderr, "Could not open a pty\n");
+		return EXIT_FAILURE;
+	}
+	slave = open(ptsname(stream.master), O_RDWR | O_NOCTTY);
+	if (slave < 0 || tcgetattr(slave, &settings) != 0)
+	{
+		fprintf(stderr, "Could not open the pty's slave end\n");
+		return EXIT_FAILURE;
+	}
+	// Raw, or the line discipline would eat and translate bytes of the frames
+	cfmakeraw(&settings);
+	tcsetattr(slave, TCSANOW, &settings);
+
+	start = nowSeconds();
+	if (pthread_create(&writer, NULL, runWriter, &stream) != 0)
+	{
+		fprintf(stderr, "Could not start the writer\n");
+		return EXIT_FAILURE;
+	}
+	ready.fd = slave;
+	ready.events = POLLIN;
+	while (got.size() < stream.expected.size())
+	{
+		if (poll(&ready, 1, LOOPTIMEOUT) <= 0)
+			break;
+		length = read(slave, buffer, sizeof(buffer));
+		if (length < 0 && errno == EINTR)
+			continue;
+		if (length <= 0)
+			break;
+		decoder.feed(buffer, length, got);
+	}
+	elapsed = nowSeconds() - start;
+	pthread_join(writer, NULL);
+	close(slave);
+	close(stream.master);
+
+	if (!sameReadings(got, stream.expected))
+	{
+		fprintf(stderr, "pty: %zu frames decoded, %zu expected\n", got.size(), stream.expected.size());
+		failures++;
+	}
+	// A damaged frame can hide a false sync, so there may be more bad CRCs than damaged frames
+	if (decoder.badCrc < stream.corrupted || decoder.lost != stream.corrupted + stream.cut)
+	{
+		fprintf(stderr, "pty: %lu bad CRC and %lu lost, expected %lu and %lu\n", decoder.badCrc, decoder.lost, stream.corrupted, stream.corrupted + stream.cut);
+		failures++;
+	}
+
+	for (i = 0; i < stream.bytes.size(); i++)
+		byteDecoder.feed(&stream.bytes[i], 1, single);
+	if (!sameReadings(single, stream.expected) || byteDecoder.badCrc != decoder.badCrc || byteDecoder.skipped != decoder.skipped)
+	{
+		fprintf(stderr, "bytewise: %zu frames, %lu bad CRC, %lu skipped; pty: %lu bad CRC, %lu skipped\n",
+			single.size(), byteDecoder.badCrc, byteDecoder.skipped, decoder.badCrc, decoder.skipped);
+		failures++;
+	}
+
+	printf("%zu frames, %zu bytes through the pty in %.3f s, %.0f frames/s\n", got.size(), stream.bytes.size(), elapsed, got.size() / elapsed);
+	printf("%lu damaged and %lu cut frames rejected, %lu bytes skipped\n", stream.corrupted, stream.cut, decoder.skipped);
+	// Ten bits a byte on the wire; an ASCII line is about 28 bytes
+	printf("link: %.0f readings/s at %d baud binary, %.0f at 9600 baud ASCII\n", WIRE_BAUD / 10.0 / WIRE_FRAME, WIRE_BAUD, 9600 / 10.0 / 28);
+	if (failures > 0)
+	{
+		printf("wire loopback FAILED\n");
+		return EXIT_FAILURE;
+	}
+	printf("wire loopback passed\n");
+	return EXIT_SUCCESS;
+}
+
+/*
+Packs a sweep of LOOPFRAMES readings into one byte stream with damage mixed in, and lists
+the readings that should come out of it
+@param stream - receives the bytes and the expected readings
+*/
+static void buildStream(LoopStream &stream)
+{
+	uint8_t frame[WIRE_FRAME];
+	WireReading reading;
+	unsigned int seed = 1;
+	int frameNumber;
+	int i;
+
+	stream.corrupted = 0;
+	stream.cut = 0;
+	for (frameNumber = 0; frameNumber < LOOPFRAMES; frameNumber++)
+	{
+		reading.sequence = (uint8_t)frameNumber;
+		reading.servo = frameNumber % 161 - 80;
+		reading.plat = frameNumber / 161 % 161 - 80;
+		for (i = 0; i < 4; i++)
+			reading.counts[i] = rand_r(&seed) % 1024;
+		packWireFrame(frame, reading.sequence, reading.servo, reading.plat, reading.counts);
+
+		if (frameNumber % LOOPJUNK == LOOPJUNK - 1)
+		{
+			// Noise on the line, a lone first sync byte among it
+			stream.bytes.push_back(0x00);
+			stream.bytes.push_back(WIRE_SYNC1);
+			stream.bytes.push_back(0x13);
+		}
+		if (frameNumber % LOOPCORRUPT == LOOPCORRUPT - 1)
+		{
+			frame[3 + frameNumber % 10] ^= 1 << frameNumber % 8;
+			stream.corrupted++;
+		}
+		else if (frameNumber % LOOPCUT == LOOPCUT - 1)
+		{
+			stream.bytes.insert(stream.bytes.end(), frame, frame + WIRE_FRAME / 2);
+			stream.cut++;
+			continue;
+		}
+		else
+		{
+			stream.expected.push_back(reading);
+		}
+		stream.bytes.insert(stream.bytes.end(), frame, frame + WIRE_FRAME);
+	}
+}
+
+/*
+Writes the whole stream to the pty in chunks, as fast as it takes them
+@param arg - the LoopStream to send
+@return - NULL
+*/
+static void *runWriter(void *arg)
+{
+	LoopStream *stream = (LoopStream *)arg;
+	size_t sent = 0;
+	size_t chunk;
+	ssize_t written;
+
+	while (sent < stream->bytes.size())
+	{
+		chunk = stream->bytes.size() - sent < LOOPCHUNK ? stream->bytes.size() - sent : LOOPCHUNK;
+		written = write(stream->master, &stream->bytes[sent], chunk);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			break;
+		sent += written;
+	}
+	return NULL;
+}
+
+/*
+Compares two lists of readings field by field
+@param got - the readings decoded
+@param expected - the readings sent
+@return - whether they are the same
+*/
+static bool sameReadings(const std::vector<WireReading> &got, const std::vector<WireReading> &expected)
+{
+	size_t i;
+
+	if (got.size() != expected.size())
+		return false;
+	for (i = 0; i < got.size(); i++)
+	{
+		if (got[i].sequence != expected[i].sequence || got[i].servo != expected[i].servo || got[i].plat != expected[i].plat ||
+				memcmp(got[i].counts, expected[i].counts, sizeof(got[i].counts)) != 0)
+			return false;
+	}
+	return true;
+}
+
+/*
+Returns a monotonic time in seconds
+*/
+static double nowSeconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
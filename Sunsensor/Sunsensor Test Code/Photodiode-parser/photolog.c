@@ -0,0 +1,339 @@
+#include "photolog.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Most numbers on a line: an optional capture timestamp then sens,plat,v1,v2,v3,v4
+#define LOGFIELDS 7
+
+_Static_assert(sizeof(log_header_t) == 64, "log header must keep the blocks aligned");
+_Static_assert(sizeof(log_block_header_t) == 32, "block header must keep the columns aligned");
+_Static_assert(LOGBLOCKSIZE % 8 == 0, "blocks must keep the timestamps aligned");
+
+static void setBlockColumns(const unsigned char *base, log_block_t *block);
+static int writeBlock(log_writer_t *writer);
+
+/*
+Decodes one line of a sweep log or capture, sens,plat,v1,v2,v3,v4 with an optional
+timestamp in front as capture writes it. A trailing comma and spaces are allowed.
+@param line - the line, ending at a newline or NUL
+@param sequence - the timestamp to give a line that has none
+@param row - receives the reading, only valid for LOG_ROW
+@return - LOG_ROW, LOG_SKIP for a blank line or LOG_MALFORMED, such as for a header line
+*/
+int decodeLogLine(const char *line, int64_t sequence, log_row_t *row) {
+	double values[LOGFIELDS];
+	const char *cursor = line;
+	char *end;
+	int64_t stamp;
+	int fields = 0;
+	int first;
+
+	while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')
+		cursor++;
+	if (*cursor == '\n' || *cursor == '\0')
+		return LOG_SKIP;
+	// A timestamp is read again as an integer, a double would round microseconds since the epoch
+	stamp = strtoll(cursor, NULL, 10);
+	while (fields < LOGFIELDS) {
+		values[fields] = strtod(cursor, &end);
+		if (end == cursor)
+			break;
+		fields++;
+		cursor = end;
+		while (*cursor == ' ' || *cursor == '\t')
+			cursor++;
+		if (*cursor != ',')
+			break;
+		cursor++;
+	}
+	while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')
+		cursor++;
+	if ((*cursor != '\n' && *cursor != '\0') || fields < LOGFIELDS - 1)
+		return LOG_MALFORMED;
+	first = fields - (LOGFIELDS - 1);
+	if (values[first] < INT8_MIN || values[first] > INT8_MAX || values[first + 1] < INT8_MIN || values[first + 1] > INT8_MAX)
+		return LOG_MALFORMED;
+	row->timestamp = first ? stamp : sequence;
+	row->servo = (int)values[first];
+	row->plat = (int)values[first + 1];
+	row->volts[0] = values[first + 2];
+	row->volts[1] = values[first + 3];
+	row->volts[2] = values[first + 4];
+	row->volts[3] = values[first + 5];
+	return LOG_ROW;
+}
+
+/*
+Opens a log to append to, creating it if it does not exist. A last block that is not full
+is read back and filled up before a new one is started.
+@param writer - the writer to set up
+@param filename - the log file
+@return - 0 on success, -1 if the file could not be opened or is not a log
+*/
+int openLogWriter(log_writer_t *writer, const char *filename) {
+	log_header_t header;
+	log_block_header_t *last;
+	long size;
+
+	// Nothing is pending until a block is read back, so closing on a failure writes nothing
+	writer->blocks = 0;
+	writer->count = 0;
+	writer->last = -1;
+	writer->fp = fopen(filename, "r+b");
+	if (writer->fp == NULL)
+		writer->fp = fopen(filename, "w+b");
+	writer->block = calloc(1, LOGBLOCKSIZE);
+	if (writer->fp == NULL || writer->block == NULL || fseek(writer->fp, 0, SEEK_END) != 0 || (size = ftell(writer->fp)) < 0) {
+		closeLogWriter(writer);
+		return -1;
+	}
+	if (size == 0) {
+		memset(&header, 0, sizeof(header));
+		header.magic = LOGMAGIC;
+		header.version = LOGVERSION;
+		header.headerSize = sizeof(header);
+		header.blockRows = LOGBLOCKROWS;
+		header.blockSize = LOGBLOCKSIZE;
+		if (fwrite(&header, sizeof(header), 1, writer->fp) != 1) {
+			closeLogWriter(writer);
+			return -1;
+		}
+		return 0;
+	}
+
+	rewind(writer->fp);
+	if (fread(&header, sizeof(header), 1, writer->fp) != 1 || header.magic != LOGMAGIC || header.version != LOGVERSION ||
+			header.blockRows != LOGBLOCKROWS || header.blockSize != LOGBLOCKSIZE || (size - sizeof(header)) % LOGBLOCKSIZE != 0) {
+		closeLogWriter(writer);
+		return -1;
+	}
+	writer->blocks = (size - sizeof(header)) / LOGBLOCKSIZE;
+	if (writer->blocks == 0)
+		return 0;
+	if (fseek(writer->fp, sizeof(header) + (writer->blocks - 1) * LOGBLOCKSIZE, SEEK_SET) != 0 ||
+			fread(writer->block, LOGBLOCKSIZE, 1, writer->fp) != 1) {
+		closeLogWriter(writer);
+		return -1;
+	}
+	last = (log_block_header_t *)writer->block;
+	writer->last = last->last;
+	if (last->count < LOGBLOCKROWS) {
+		writer->blocks--;
+		writer->count = last->count;
+	}
+	else {
+		memset(writer->block, 0, LOGBLOCKSIZE);
+	}
+	return 0;
+}
+
+/*
+Adds one reading to the end of the log. Readings should come in timestamp order for
+seekPhotoLog to find them.
+@param writer - the writer
+@param row - the reading
+@return - 0 on success, -1 if a full block could not be written
+*/
+int appendLogRow(log_writer_t *writer, const log_row_t *row) {
+	log_block_header_t *header = (log_block_header_t *)writer->block;
+	unsigned char *column = writer->block + sizeof(log_block_header_t);
+	size_t i = writer->count;
+
+	if (i == 0)
+		header->first = row->timestamp;
+	((int64_t *)column)[i] = row->timestamp;
+	column += LOGBLOCKROWS * sizeof(int64_t);
+	((float *)column)[i] = row->volts[0];
+	((float *)column)[i + LOGBLOCKROWS] = row->volts[1];
+	((float *)column)[i + 2 * LOGBLOCKROWS] = row->volts[2];
+	((float *)column)[i + 3 * LOGBLOCKROWS] = row->volts[3];
+	column += 4 * LOGBLOCKROWS * sizeof(float);
+	((int8_t *)column)[i] = row->servo;
+	((int8_t *)column)[i + LOGBLOCKROWS] = row->plat;
+	header->last = row->timestamp;
+	header->count = ++writer->count;
+	writer->last = row->timestamp;
+	if (writer->count < LOGBLOCKROWS)
+		return 0;
+	if (writeBlock(writer) != 0)
+		return -1;
+	writer->blocks++;
+	writer->count = 0;
+	memset(writer->block, 0, LOGBLOCKSIZE);
+	return 0;
+}
+
+/*
+Writes out the block being filled so readers see every row appended so far. The block is
+written again in place as it fills.
+@param writer - the writer
+@return - 0 on success, -1 if the block could not be written
+*/
+int flushLogWriter(log_writer_t *writer) {
+	if (writer->count > 0 && writeBlock(writer) != 0)
+		return -1;
+	return fflush(writer->fp) == 0 ? 0 : -1;
+}
+
+/*
+Flushes and closes a log writer
+@param writer - the writer
+@return - 0 on success, -1 if the last rows could not be written
+*/
+int closeLogWriter(log_writer_t *writer) {
+	int status = 0;
+
+	if (writer->fp != NULL) {
+		if (writer->block != NULL && flushLogWriter(writer) != 0)
+			status = -1;
+		if (fclose(writer->fp) != 0)
+			status = -1;
+	}
+	free(writer->block);
+	writer->fp = NULL;
+	writer->block = NULL;
+	return status;
+}
+
+/*
+Maps a whole log read only, so its columns can be read without copying. The writer only
+starts a block once the one before is full, so a log with a block holding more than
+LOGBLOCKROWS rows, or a short block before the last, is taken as corrupt.
+@param log - receives the mapping
+@param filename - the log file
+@return - 0 on success, -1 if the file could not be mapped or is not a log
+*/
+int mapPhotoLog(photolog_t *log, const char *filename) {
+	const log_header_t *header;
+	const log_block_header_t *block;
+	struct stat info;
+	size_t i;
+	int fd = open(filename, O_RDONLY);
+
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(log_header_t)) {
+		close(fd);
+		return -1;
+	}
+	log->size = info.st_size;
+	log->map = mmap(NULL, log->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (log->map == MAP_FAILED)
+		return -1;
+	header = (const log_header_t *)log->map;
+	if (header->magic != LOGMAGIC || header->version != LOGVERSION || header->blockRows != LOGBLOCKROWS ||
+			header->blockSize != LOGBLOCKSIZE || (log->size - sizeof(log_header_t)) % LOGBLOCKSIZE != 0) {
+		unmapPhotoLog(log);
+		return -1;
+	}
+	log->blocks = (log->size - sizeof(log_header_t)) / LOGBLOCKSIZE;
+	log->rows = 0;
+	for (i = 0; i < log->blocks; i++) {
+		block = (const log_block_header_t *)(log->map + sizeof(log_header_t) + i * LOGBLOCKSIZE);
+		if (block->count > LOGBLOCKROWS || (block->count < LOGBLOCKROWS && i + 1 < log->blocks)) {
+			unmapPhotoLog(log);
+			return -1;
+		}
+		log->rows += block->count;
+	}
+	return 0;
+}
+
+/*
+Releases a mapped log
+@param log - the log
+*/
+void unmapPhotoLog(photolog_t *log) {
+	munmap((void *)log->map, log->size);
+	log->map = NULL;
+	log->size = 0;
+	log->blocks = 0;
+	log->rows = 0;
+}
+
+/*
+Gives the columns of one block of a mapped log
+@param log - the log
+@param index - the block, less than log->blocks
+@param block - receives the columns
+*/
+void getLogBlock(const photolog_t *log, size_t index, log_block_t *block) {
+	setBlockColumns(log->map + sizeof(log_header_t) + index * LOGBLOCKSIZE, block);
+}
+
+/*
+Finds the first reading at or after a time, with a binary search over the blocks and then
+within one
+@param log - the log, its readings in timestamp order
+@param timestamp - the time to look for
+@param row - receives the row within the block
+@return - the block, log->blocks if every reading is earlier
+*/
+size_t seekPhotoLog(const photolog_t *log, int64_t timestamp, size_t *row) {
+	const log_block_header_t *header;
+	log_block_t block;
+	size_t lo = 0;
+	size_t hi = log->blocks;
+	size_t mid;
+
+	// The first block whose last reading is not earlier holds the answer
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		header = (const log_block_header_t *)(log->map + sizeof(log_header_t) + mid * LOGBLOCKSIZE);
+		if (header->count == 0 || header->last < timestamp)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*row = 0;
+	if (lo == log->blocks)
+		return lo;
+	getLogBlock(log, lo, &block);
+	hi = block.count;
+	while (*row < hi) {
+		mid = *row + (hi - *row) / 2;
+		if (block.timestamp[mid] < timestamp)
+			*row = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+Points the column pointers of a block view at a block
+@param base - the start of the block
+@param block - receives the columns
+*/
+static void setBlockColumns(const unsigned char *base, log_block_t *block) {
+	const unsigned char *column = base + sizeof(log_block_header_t);
+	const float *volts;
+
+	block->count = ((const log_block_header_t *)base)->count;
+	block->timestamp = (const int64_t *)column;
+	column += LOGBLOCKROWS * sizeof(int64_t);
+	volts = (const float *)column;
+	block->volt1 = volts;
+	block->volt2 = volts + LOGBLOCKROWS;
+	block->volt3 = volts + 2 * LOGBLOCKROWS;
+	block->volt4 = volts + 3 * LOGBLOCKROWS;
+	column += 4 * LOGBLOCKROWS * sizeof(float);
+	block->servo = (const int8_t *)column;
+	block->plat = (const int8_t *)column + LOGBLOCKROWS;
+}
+
+/*
+Writes the block being filled at its place in the file
+@param writer - the writer
+@return - 0 on success, -1 on failure
+*/
+static int writeBlock(log_writer_t *writer) {
+	if (fseek(writer->fp, sizeof(log_header_t) + writer->blocks * LOGBLOCKSIZE, SEEK_SET) != 0)
+		return -1;
+	return fwrite(writer->block, LOGBLOCKSIZE, 1, writer->fp) == 1 ? 0 : -1;
+}
@@ -0,0 +1,97 @@
+#ifndef PHOTOLOG_H
+#define PHOTOLOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// "PDLG" read as a little endian word, a file written on the other endianness won't match
+#define LOGMAGIC 0x474c4450u
+#define LOGVERSION 1
+// Rows each block has room for. Every block takes the same space on disk, so block i is at
+// a fixed offset and seeking is a binary search over the block headers.
+#define LOGBLOCKROWS 4096
+#define LOGBLOCKSIZE (sizeof(log_block_header_t) + LOGBLOCKROWS * (sizeof(int64_t) + 4 * sizeof(float) + 2 * sizeof(int8_t)))
+
+// Results of decoding one text line
+#define LOG_ROW 1
+#define LOG_SKIP 0
+#define LOG_MALFORMED -1
+
+// Header at the start of a log file, followed by the blocks
+typedef struct log_header_s {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t blockRows;
+	uint64_t blockSize;
+	uint32_t reserved[10];
+} log_header_t;
+
+// Header at the start of each block. The columns follow it, each LOGBLOCKROWS long with
+// only the first count in use: timestamp (int64 microseconds), volt1..volt4 (float, as
+// recorded), then servo and plat (int8 degrees).
+typedef struct log_block_header_s {
+	uint32_t count;
+	uint32_t reserved;
+	int64_t first;
+	int64_t last;
+	uint64_t pad;
+} log_block_header_t;
+
+// One sens,plat,v1,v2,v3,v4 reading and when it was taken
+typedef struct log_row_s {
+	int64_t timestamp;
+	int servo;
+	int plat;
+	float volts[4];
+} log_row_t;
+
+// The columns of one block, pointing straight into the mapped file
+typedef struct log_block_s {
+	size_t count;
+	const int64_t *timestamp;
+	const float *volt1;
+	const float *volt2;
+	const float *volt3;
+	const float *volt4;
+	const int8_t *servo;
+	const int8_t *plat;
+} log_block_t;
+
+// Appends rows to a log, filling one block in memory and writing it in place
+typedef struct log_writer_s {
+	FILE *fp;
+	unsigned char *block;
+	size_t blocks;
+	size_t count;
+	int64_t last;
+} log_writer_t;
+
+// A whole log mapped read only
+typedef struct photolog_s {
+	const unsigned char *map;
+	size_t size;
+	size_t blocks;
+	size_t rows;
+} photolog_t;
+
+int decodeLogLine(const char *line, int64_t sequence, log_row_t *row);
+
+int openLogWriter(log_writer_t *writer, const char *filename);
+
+int appendLogRow(log_writer_t *writer, const log_row_t *row);
+
+int flushLogWriter(log_writer_t *writer);
+
+int closeLogWriter(log_writer_t *writer);
+
+int mapPhotoLog(photolog_t *log, const char *filename);
+
+void unmapPhotoLog(photolog_t *log);
+
+void getLogBlock(const photolog_t *log, size_t index, log_block_t *block);
+
+size_t seekPhotoLog(const photolog_t *log, int64_t timestamp, size_t *row);
+
+#endif
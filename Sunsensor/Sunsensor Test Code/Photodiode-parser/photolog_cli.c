@@ -0,0 +1,157 @@
+#include "photolog.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Longest text line read, longer ones are counted as malformed
+#define LOGLINE 4096
+
+static int appendText(log_writer_t *writer, FILE *fp, unsigned long *rows, unsigned long *malformed);
+static int dumpLog(const photolog_t *log, int64_t from, int64_t to, int stamped);
+
+/*
+Keeps sweep logs and captures as packed binary columns, so analysis over weeks of
+recordings reads mapped columns instead of parsing CSV again.
+usage: photolog append <log> [text...]
+       photolog dump [-f from] [-t to] [-T] <log>
+       photolog info <log>
+  append  decodes sens,plat,v1,v2,v3,v4 lines, with or without the capture timestamp, from
+          the text files or standard input and adds them to the log. Lines without a
+          timestamp are numbered on from the last reading.
+  dump    prints the readings from time from up to and including time to as text
+  -T      leaves the timestamps out, giving the sweep log format back
+  info    prints the number of readings and blocks and the time they span
+*/
+int main(int argc, char *argv[]) {
+	log_writer_t writer;
+	photolog_t log;
+	log_block_t block;
+	unsigned long rows = 0;
+	unsigned long malformed = 0;
+	int64_t from = INT64_MIN;
+	int64_t to = INT64_MAX;
+	int stamped = 1;
+	int status = 0;
+	FILE *fp;
+	int option;
+	int i;
+
+	if (argc >= 3 && strcmp(argv[1], "append") == 0) {
+		if (openLogWriter(&writer, argv[2]) != 0) {
+			fprintf(stderr, "Could not open %s as a log\n", argv[2]);
+			return EXIT_FAILURE;
+		}
+		if (argc == 3)
+			status = appendText(&writer, stdin, &rows, &malformed);
+		for (i = 3; i < argc && status == 0; i++) {
+			fp = strcmp(argv[i], "-") == 0 ? stdin : fopen(argv[i], "r");
+			if (fp == NULL) {
+				fprintf(stderr, "Could not read %s\n", argv[i]);
+				status = -1;
+				break;
+			}
+			status = appendText(&writer, fp, &rows, &malformed);
+			if (fp != stdin)
+				fclose(fp);
+		}
+		if (closeLogWriter(&writer) != 0)
+			status = -1;
+		fprintf(stderr, "%lu readings added, %lu malformed lines\n", rows, malformed);
+		return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (argc >= 3 && strcmp(argv[1], "dump") == 0) {
+		optind = 2;
+		while ((option = getopt(argc, argv, "f:t:T")) != -1) {
+			if (option == 'f')
+				from = strtoll(optarg, NULL, 10);
+			else if (option == 't')
+				to = strtoll(optarg, NULL, 10);
+			else if (option == 'T')
+				stamped = 0;
+			else
+				optind = argc + 1;
+		}
+		if (optind != argc - 1 || mapPhotoLog(&log, argv[optind]) != 0) {
+			fprintf(stderr, "Could not map %s as a log\n", optind < argc ? argv[optind] : "");
+			return EXIT_FAILURE;
+		}
+		status = dumpLog(&log, from, to, stamped);
+		unmapPhotoLog(&log);
+		return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (argc == 3 && strcmp(argv[1], "info") == 0) {
+		if (mapPhotoLog(&log, argv[2]) != 0) {
+			fprintf(stderr, "Could not map %s as a log\n", argv[2]);
+			return EXIT_FAILURE;
+		}
+		printf("%zu readings in %zu blocks\n", log.rows, log.blocks);
+		if (log.rows > 0) {
+			getLogBlock(&log, 0, &block);
+			printf("From %lld", (long long)block.timestamp[0]);
+			getLogBlock(&log, log.blocks - 1, &block);
+			printf(" to %lld\n", (long long)block.timestamp[block.count - 1]);
+		}
+		unmapPhotoLog(&log);
+		return EXIT_SUCCESS;
+	}
+
+	fprintf(stderr, "usage: %s append <log> [text...]\n       %s dump [-f from] [-t to] [-T] <log>\n       %s info <log>\n", argv[0], argv[0], argv[0]);
+	return EXIT_FAILURE;
+}
+
+/*
+Decodes every line of a text stream into the log
+@param writer - the log being appended to
+@param fp - the text
+@param rows - counts readings added
+@param malformed - counts lines that could not be decoded
+@return - 0 on success, -1 if the log could not be written
+*/
+static int appendText(log_writer_t *writer, FILE *fp, unsigned long *rows, unsigned long *malformed) {
+	char line[LOGLINE];
+	log_row_t row;
+	int result;
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		result = decodeLogLine(line, writer->last + 1, &row);
+		if (result == LOG_MALFORMED) {
+			(*malformed)++;
+		}
+		else if (result == LOG_ROW) {
+			if (appendLogRow(writer, &row) != 0)
+				return -1;
+			(*rows)++;
+		}
+		// Skip the rest of a line too long for the buffer
+		while (strchr(line, '\n') == NULL && fgets(line, sizeof(line), fp) != NULL);
+	}
+	return 0;
+}
+
+/*
+Prints the readings of a time range as text
+@param log - the mapped log
+@param from - the earliest time to print
+@param to - the latest time to print
+@param stamped - whether to put the timestamp in front
+@return - 0 on success, -1 if the output could not be written
+*/
+static int dumpLog(const photolog_t *log, int64_t from, int64_t to, int stamped) {
+	log_block_t block;
+	size_t row;
+	size_t index = seekPhotoLog(log, from, &row);
+
+	for (; index < log->blocks; index++, row = 0) {
+		getLogBlock(log, index, &block);
+		for (; row < block.count; row++) {
+			if (block.timestamp[row] > to)
+				return fflush(stdout) == 0 ? 0 : -1;
+			if (stamped)
+				printf("%lld,", (long long)block.timestamp[row]);
+			printf("%d,%d,%g,%g,%g,%g,\n", block.servo[row], block.plat[row], block.volt1[row], block.volt2[row], block.volt3[row], block.volt4[row]);
+		}
+	}
+	return fflush(stdout) == 0 ? 0 : -1;
+}
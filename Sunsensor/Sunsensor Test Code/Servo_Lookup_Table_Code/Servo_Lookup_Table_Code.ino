@@ -17,8 +17,12 @@
 #define C4 1.0
 #define WIDTH 3.0
 #define HEIGHT 1.5
+// 1 sends each reading as a binary frame from sweep_wire.h at WIRE_BAUD, decoded on the
+// host with wire_decode; 0 prints the old sens,plat,v1,v2,v3,v4 text line at 9600 baud
+#define BINARY_OUTPUT 1
 #include <math.h>
 #include <Servo.h>
+#include "sweep_wire.h"
 
 Servo Sensor;
 Servo Platform;
@@ -31,6 +35,7 @@ int voltage4;
 double sum;
 double alpha;
 double beta;
+uint8_t sequence = 0;
 
 void setup() {
   pinMode(VOLTAGE1_PIN, INPUT);
@@ -38,7 +43,11 @@ void setup() {
   pinMode(VOLTAGE3_PIN, INPUT);
   pinMode(VOLTAGE4_PIN, INPUT);
   
+#if BINARY_OUTPUT
+  Serial.begin(WIRE_BAUD);
+#else
   Serial.begin(9600);
+#endif
   Sensor.attach(SENSOR_PIN);
   Platform.attach(PLATFORM_PIN);
   Sensor.write(SERVO_START_ANGLE);
@@ -86,6 +95,13 @@ void readAndCalc() {
 }
 
 void serialPrint() {
+#if BINARY_OUTPUT
+  // Raw ADC counts go out; the C1..C4 gains, all 1.0, are left to the host
+  uint8_t frame[WIRE_FRAME];
+  uint16_t counts[4] = { (uint16_t)voltage1, (uint16_t)voltage2, (uint16_t)voltage3, (uint16_t)voltage4 };
+  packWireFrame(frame, sequence++, sens, plat, counts);
+  Serial.write(frame, WIRE_FRAME);
+#else
   Serial.print(   // "AnglesInput: "
                    String(sens) + ','
                  + String(plat) + ','
@@ -99,6 +115,7 @@ void serialPrint() {
                  //+ String(beta) + ','
                 
                  + '\n');
+#endif
 }
 
 void sweep(bool right) {
@@ -0,0 +1,72 @@
+#ifndef SWEEP_WIRE_H
+#define SWEEP_WIRE_H
+
+/*
+Binary frame for one sweep reading, shared by the sketch that sends it and the host tools
+that decode it. 15 bytes against 26 to 30 for the ASCII line, and no String building on
+the Arduino. All multi byte fields are little endian.
+  0   WIRE_SYNC1
+  1   WIRE_SYNC2
+  2   sequence number, one more each frame, so the host can count frames it lost
+  3   servo angle, int8 degrees
+  4   platform angle, int8 degrees
+  5   four uint16 ADC counts, voltage1..voltage4
+  13  CRC-16/CCITT (polynomial 0x1021, start 0xffff) of bytes 2 to 12
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define WIRE_SYNC1 0xa5
+#define WIRE_SYNC2 0x5a
+#define WIRE_FRAME 15
+// Bytes covered by the CRC, from the sequence number to the last count
+#define WIRE_BODY 11
+#define WIRE_BAUD 115200
+
+/*
+Calculates the CRC-16/CCITT of some bytes, bit by bit so it needs no table in flash
+@param data - the bytes
+@param length - how many
+@return - the CRC
+*/
+static inline uint16_t getWireCrc(const uint8_t *data, size_t length) {
+	uint16_t crc = 0xffff;
+	size_t i;
+	int bit;
+
+	for (i = 0; i < length; i++) {
+		crc ^= (uint16_t)data[i] << 8;
+		for (bit = 0; bit < 8; bit++)
+			crc = crc & 0x8000 ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+	}
+	return crc;
+}
+
+/*
+Packs one reading into a frame
+@param frame - receives WIRE_FRAME bytes
+@param sequence - the frame number
+@param servo - the servo angle
+@param plat - the platform angle
+@param counts - the four ADC counts
+*/
+static inline void packWireFrame(uint8_t *frame, uint8_t sequence, int8_t servo, int8_t plat, const uint16_t *counts) {
+	uint16_t crc;
+	int i;
+
+	frame[0] = WIRE_SYNC1;
+	frame[1] = WIRE_SYNC2;
+	frame[2] = sequence;
+	frame[3] = (uint8_t)servo;
+	frame[4] = (uint8_t)plat;
+	for (i = 0; i < 4; i++) {
+		frame[5 + 2 * i] = counts[i] & 0xff;
+		frame[6 + 2 * i] = counts[i] >> 8;
+	}
+	crc = getWireCrc(frame + 2, WIRE_BODY);
+	frame[13] = crc & 0xff;
+	frame[14] = crc >> 8;
+}
+
+#endif
@@ -0,0 +1,271 @@
+#define _DEFAULT_SOURCE
+#include "sweep_wire.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+// The sensor geometry of readAndCalc in Servo_Lookup_Table_Code: a WIDTH wide window at
+// HEIGHT over four WIDTH / 2 square quadrants, voltage1 +x+y, voltage2 +x-y, voltage3 -x-y
+// and voltage4 -x+y, with x and y the head frame of sun_vector.h: x towards positive platform
+// angles and y towards positive servo angles
+#define WIDTH 3.0
+#define HEIGHT 1.5
+// The sketch sweeps both servos from SIMMIN up to SIMMAX - 1 degrees
+#define SIMMIN -30
+#define SIMMAX 30
+// What the rig spends on each reading and each platform step, in milliseconds: a delay
+// before each reading, then DATA_DELAY before and after each of the four analogReads
+#define RIGREADING 300
+#define RIGSTEP 200
+#define RIGSTART 1000
+// ADC counts of a fully lit quadrant, and of the noise on each reading
+#define SIMLEVEL 600.0
+#define SIMNOISE 2.0
+#define SIMSEED 1
+#define SIMMAXCOUNT 1023
+
+// State of the noise generator, a xorshift so runs repeat on any platform
+typedef struct sim_noise_s {
+	uint64_t state;
+	double spare;
+	int hasSpare;
+} sim_noise_t;
+
+static void getModelVoltage(double servo, double plat, double *volts);
+static double getLitLength(double shift, int positive);
+static void emitReading(FILE *out, int binary, uint8_t sequence, int servo, int plat, const uint16_t *counts);
+static void writeModelTable(FILE *out);
+static double getNoise(sim_noise_t *noise);
+static double getUniform(sim_noise_t *noise);
+static void waitRate(double rate);
+
+/*
+Stands in for the sweep rig of Servo_Lookup_Table_Code so tables can be built and the
+capture tools tested without hardware. It visits the servo and platform angles in the order
+the sketch does, turns each pair into the four photodiode readings of the geometry that
+readAndCalc assumes, adds noise and rounds to ADC counts, and writes them as the sketch
+would: text lines, or binary frames as with BINARY_OUTPUT. The readings the sketch goes on
+sending from loop() after the sweep are not simulated.
+usage: sweep_sim [-w] [-m] [-c passes] [-l level] [-s noise] [-S seed] [-r rate] [-o output]
+  -w  write binary frames from sweep_wire.h instead of text lines
+  -m  write the noise free table of the model in lookup.txt form and nothing else
+  -c  sweep this many times over, default 1
+  -l  ADC counts of a fully lit quadrant, default SIMLEVEL
+  -s  standard deviation of the noise in ADC counts, default SIMNOISE
+  -S  seed for the noise, default SIMSEED, so a run can be repeated exactly
+  -r  readings written per second, default 0 for as fast as the output takes them
+  -o  the file or device to write to, default standard output
+Prints how long the rig would have taken for the same readings.
+*/
+int main(int argc, char *argv[]) {
+	sim_noise_t noise;
+	uint16_t counts[4];
+	double volts[4];
+	double level = SIMLEVEL;
+	double sigma = SIMNOISE;
+	double rate = 0;
+	double count;
+	const char *output = NULL;
+	unsigned long readings = 0;
+	long passes = 1;
+	long pass;
+	FILE *out = stdout;
+	int binary = 0;
+	int model = 0;
+	int servo;
+	int plat;
+	int step;
+	int option;
+	int i;
+
+	noise.state = SIMSEED;
+	noise.hasSpare = 0;
+	while ((option = getopt(argc, argv, "wmc:l:s:S:r:o:")) != -1) {
+		if (option == 'w')
+			binary = 1;
+		else if (option == 'm')
+			model = 1;
+		else if (option == 'c')
+			passes = atol(optarg);
+		else if (option == 'l')
+			level = atof(optarg);
+		else if (option == 's')
+			sigma = atof(optarg);
+		else if (option == 'S')
+			noise.state = strtoull(optarg, NULL, 10);
+		else if (option == 'r')
+			rate = atof(optarg);
+		else if (option == 'o')
+			output = optarg;
+		else
+			optind = argc + 1;
+	}
+	if (optind != argc) {
+		fprintf(stderr, "usage: %s [-w] [-m] [-c passes] [-l level] [-s noise] [-S seed] [-r rate] [-o output]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	// A zero state would stay zero
+	if (noise.state == 0)
+		noise.state = SIMSEED;
+	if (output != NULL && (out = fopen(output, "w")) == NULL) {
+		fprintf(stderr, "Could not open %s\n", output);
+		return EXIT_FAILURE;
+	}
+	if (model) {
+		writeModelTable(out);
+		return fclose(out) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	for (pass = 0; pass < passes; pass++) {
+		for (plat = SIMMIN; plat < SIMMAX; plat++) {
+			// sweep(plat % 2) goes up the servo angles on odd platform angles, down on even
+			for (step = 0; step < SIMMAX - SIMMIN; step++) {
+				servo = plat % 2 ? SIMMIN + step : SIMMAX - 1 - step;
+				getModelVoltage(servo, plat, volts);
+				for (i = 0; i < 4; i++) {
+					count = round(level * volts[i] + sigma * getNoise(&noise));
+					counts[i] = count < 0 ? 0 : count > SIMMAXCOUNT ? SIMMAXCOUNT : count;
+				}
+				emitReading(out, binary, (uint8_t)readings, servo, plat, counts);
+				readings++;
+				if (rate > 0)
+					waitRate(rate);
+			}
+		}
+	}
+	if (fclose(out) != 0) {
+		fprintf(stderr, "Could not write %s\n", output == NULL ? "the output" : output);
+		return EXIT_FAILURE;
+	}
+	fprintf(stderr, "%lu readings, %.1f minutes on the rig\n", readings,
+		(RIGSTART + passes * ((SIMMAX - SIMMIN) * RIGSTEP + (SIMMAX - SIMMIN) * (SIMMAX - SIMMIN) * (double)RIGREADING)) / 60000.0);
+	return EXIT_SUCCESS;
+}
+
+/*
+Works out how much of each quadrant is lit, as a fraction of the quadrant, for a sun at the
+given rig angles. The sun's direction is getAngleVector's in sun_vector.c, the servo nested
+inside the platform, and the window's light shifts by HEIGHT times its slope on each axis, so
+the servo comes back exactly from the voltage1 and voltage4 side, but the platform side gives
+atan(tan(plat) / cos(servo)).
+@param servo - the servo angle in degrees, about x and positive towards voltage1 and voltage4
+@param plat - the platform angle in degrees, about y and positive towards voltage1 and voltage2
+@param volts - receives the four fractions, voltage1 to voltage4
+*/
+static void getModelVoltage(double servo, double plat, double *volts) {
+	double sunX = sin(plat * M_PI / 180);
+	double sunY = cos(plat * M_PI / 180) * sin(servo * M_PI / 180);
+	double sunZ = cos(plat * M_PI / 180) * cos(servo * M_PI / 180);
+	double x = HEIGHT * sunX / sunZ;
+	double y = HEIGHT * sunY / sunZ;
+	double area = (WIDTH / 2) * (WIDTH / 2);
+
+	volts[0] = getLitLength(x, 1) * getLitLength(y, 1) / area;
+	volts[1] = getLitLength(x, 1) * getLitLength(y, 0) / area;
+	volts[2] = getLitLength(x, 0) * getLitLength(y, 0) / area;
+	volts[3] = getLitLength(x, 0) * getLitLength(y, 1) / area;
+}
+
+/*
+Gives how much of one half of the detector the window's light covers along one axis
+@param shift - how far the light has moved along the axis
+@param positive - 1 for the half on the positive side, 0 for the other
+@return - the length covered, from 0 to WIDTH / 2
+*/
+static double getLitLength(double shift, int positive) {
+	double low = positive ? 0 : -WIDTH / 2;
+	double high = positive ? WIDTH / 2 : 0;
+	double length = fmin(high, shift + WIDTH / 2) - fmax(low, shift - WIDTH / 2);
+
+	return length > 0 ? length : 0;
+}
+
+/*
+Writes one reading the way the sketch sends it
+@param out - the output
+@param binary - whether to write a binary frame rather than a text line
+@param sequence - the frame number
+@param servo - the servo angle
+@param plat - the platform angle
+@param counts - the four ADC counts
+*/
+static void emitReading(FILE *out, int binary, uint8_t sequence, int servo, int plat, const uint16_t *counts) {
+	uint8_t frame[WIRE_FRAME];
+
+	if (binary) {
+		packWireFrame(frame, sequence, servo, plat, counts);
+		fwrite(frame, WIRE_FRAME, 1, out);
+	}
+	else {
+		// String() of a double, as C1 * voltage1 is, always has two decimals
+		fprintf(out, "%d,%d,%.2f,%.2f,%.2f,%.2f\n", servo, plat, (double)counts[0], (double)counts[1], (double)counts[2], (double)counts[3]);
+	}
+}
+
+/*
+Writes the noise free model over the sweep's angles as a table in the form and row order
+build_table writes lookup.txt, so a built table can be compared with it line by line
+@param out - the output
+*/
+static void writeModelTable(FILE *out) {
+	double volts[4];
+	double sum;
+	int servo;
+	int plat;
+
+	for (plat = SIMMIN; plat < SIMMAX; plat++) {
+		for (servo = SIMMIN; servo < SIMMAX; servo++) {
+			getModelVoltage(servo, plat, volts);
+			sum = volts[0] + volts[1] + volts[2] + volts[3];
+			fprintf(out, "%d,%d,%.4f,%.4f,%.4f,%.4f,\n\n", servo, plat, volts[0] / sum, volts[1] / sum, volts[2] / sum, volts[3] / sum);
+		}
+	}
+}
+
+/*
+Gives normally distributed noise with a standard deviation of one, by the Box-Muller method
+@param noise - the generator
+@return - the next value
+*/
+static double getNoise(sim_noise_t *noise) {
+	double radius;
+	double turn;
+
+	if (noise->hasSpare) {
+		noise->hasSpare = 0;
+		return noise->spare;
+	}
+	radius = sqrt(-2 * log(getUniform(noise)));
+	turn = 2 * M_PI * getUniform(noise);
+	noise->spare = radius * sin(turn);
+	noise->hasSpare = 1;
+	return radius * cos(turn);
+}
+
+/*
+Gives a uniformly distributed number from a xorshift generator
+@param noise - the generator
+@return - a number above 0 and at most 1, never 0 so its log is finite
+*/
+static double getUniform(sim_noise_t *noise) {
+	noise->state ^= noise->state << 13;
+	noise->state ^= noise->state >> 7;
+	noise->state ^= noise->state << 17;
+	return ((noise->state >> 11) + 1.0) / 9007199254740992.0;
+}
+
+/*
+Waits one reading's time at the given rate
+@param rate - readings per second
+*/
+static void waitRate(double rate) {
+	struct timespec wait;
+	double seconds = 1 / rate;
+
+	wait.tv_sec = (time_t)seconds;
+	wait.tv_nsec = (seconds - wait.tv_sec) * 1e9;
+	nanosleep(&wait, NULL);
+}
@@ -0,0 +1,158 @@
+#include "analytic.h"
+#include <float.h>
+
+#define DEGREES (180.0f / (float)M_PI)
+
+static float getAxisAngle(float positive, float negative);
+
+/*
+Approximates atan with a minimax polynomial on [-1, 1], using atan(x) = pi/2 - atan(1/x)
+above it. Both sides are always worked out and one is picked, so there is no branch to
+mispredict and loops over it vectorize. Within 0.0006 degrees of atan.
+@param x - any finite value
+@return - atan(x) in radians
+*/
+float fastAtan(float x) {
+	float a = fabsf(x);
+	int inverted = a > 1.0f;
+	float t = inverted ? 1.0f / a : a;
+	float t2 = t * t;
+	float p = t * (0.99997726f + t2 * (-0.33262347f + t2 * (0.19354346f + t2 * (-0.11643287f + t2 * (0.05265332f + t2 * -0.01172120f)))));
+
+	p = inverted ? (float)M_PI_2 - p : p;
+	return copysignf(p, x);
+}
+
+/*
+Works out the sun angles straight from a reading with the difference over maximum formula of
+readAndCalc, in constant time and without a table. Each axis compares the two quadrants on
+one side with the two on the other. A dark reading gives 0, 0.
+@param realVolts - the voltage readings, at any scale
+@param angle - receives alpha (x, the platform's side, from voltage1 + voltage2 against
+voltage3 + voltage4) and beta (y, the servo's side, from voltage1 + voltage4 against
+voltage2 + voltage3) in degrees
+*/
+void getAnglesAnalytic(const voltage_t *realVolts, anglef_t *angle) {
+	angle->alpha = getAxisAngle(realVolts->volt1 + realVolts->volt2, realVolts->volt3 + realVolts->volt4);
+	angle->beta = getAxisAngle(realVolts->volt1 + realVolts->volt4, realVolts->volt2 + realVolts->volt3);
+}
+
+/*
+Works out the analytic angles of many readings, see getAnglesAnalytic
+@param realVolts - n voltage readings
+@param n - the number of readings
+@param angles - receives n angles
+*/
+void getAnglesAnalyticBatch(const voltage_t *realVolts, size_t n, anglef_t *angles) {
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		angles[i].alpha = getAxisAngle(realVolts[i].volt1 + realVolts[i].volt2, realVolts[i].volt3 + realVolts[i].volt4);
+		angles[i].beta = getAxisAngle(realVolts[i].volt1 + realVolts[i].volt4, realVolts[i].volt2 + realVolts[i].volt3);
+	}
+}
+
+/*
+Sets the map of a rig built to the ideal geometry, servo from beta and platform from alpha
+@param analytic - the map to set
+*/
+void initAnalytic(analytic_t *analytic) {
+	analytic->servo[0] = 0;
+	analytic->servo[1] = 1;
+	analytic->servo[2] = 0;
+	analytic->plat[0] = 1;
+	analytic->plat[1] = 0;
+	analytic->plat[2] = 0;
+	analytic->rmsError = 0;
+}
+
+/*
+Fits the map from analytic angles to a table's servo and platform angles by least squares
+over every row of the table
+@param analytic - receives the map, unchanged on failure
+@param table - a loaded lookup table
+@return - 0 on success, -1 if the table has too few distinct rows to fit
+*/
+int fitAnalytic(analytic_t *analytic, const lookup_table_t *table) {
+	double normal[3][3] = { { 0 } };
+	double servoSum[3] = { 0 };
+	double platSum[3] = { 0 };
+	double inverse[3][3];
+	double terms[3];
+	double det;
+	double error = 0;
+	voltage_t norm;
+	anglef_t angle;
+	anglef_t mapped;
+	size_t row;
+	int i;
+	int j;
+
+	for (row = 0; row < table->count; row++) {
+		getTableVoltage(table, row, &norm);
+		getAnglesAnalytic(&norm, &angle);
+		terms[0] = angle.alpha;
+		terms[1] = angle.beta;
+		terms[2] = 1;
+		for (i = 0; i < 3; i++) {
+			for (j = 0; j < 3; j++)
+				normal[i][j] += terms[i] * terms[j];
+			servoSum[i] += terms[i] * table->servo[row];
+			platSum[i] += terms[i] * table->plat[row];
+		}
+	}
+
+	// Both fits share the normal matrix, so it is inverted once by cofactors
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 3; j++) {
+			inverse[j][i] = normal[(i + 1) % 3][(j + 1) % 3] * normal[(i + 2) % 3][(j + 2) % 3] -
+				normal[(i + 1) % 3][(j + 2) % 3] * normal[(i + 2) % 3][(j + 1) % 3];
+		}
+	}
+	det = normal[0][0] * inverse[0][0] + normal[0][1] * inverse[1][0] + normal[0][2] * inverse[2][0];
+	if (table->count < 3 || fabs(det) < 1e-9 * normal[0][0] * normal[1][1] * normal[2][2])
+		return -1;
+	for (i = 0; i < 3; i++) {
+		analytic->servo[i] = (inverse[i][0] * servoSum[0] + inverse[i][1] * servoSum[1] + inverse[i][2] * servoSum[2]) / det;
+		analytic->plat[i] = (inverse[i][0] * platSum[0] + inverse[i][1] * platSum[1] + inverse[i][2] * platSum[2]) / det;
+	}
+
+	for (row = 0; row < table->count; row++) {
+		getTableVoltage(table, row, &norm);
+		getAnglesAnalytic(&norm, &angle);
+		mapAnalytic(analytic, &angle, &mapped);
+		error += (mapped.alpha - table->servo[row]) * (mapped.alpha - table->servo[row]) +
+			(mapped.beta - table->plat[row]) * (mapped.beta - table->plat[row]);
+	}
+	analytic->rmsError = sqrt(error / table->count);
+	return 0;
+}
+
+/*
+Maps analytic angles onto servo and platform angles
+@param analytic - the map
+@param angle - angles from getAnglesAnalytic
+@param mapped - receives the servo angle as alpha and the platform angle as beta
+*/
+void mapAnalytic(const analytic_t *analytic, const anglef_t *angle, anglef_t *mapped) {
+	float alpha = angle->alpha;
+	float beta = angle->beta;
+
+	mapped->alpha = analytic->servo[0] * alpha + analytic->servo[1] * beta + analytic->servo[2];
+	mapped->beta = analytic->plat[0] * alpha + analytic->plat[1] * beta + analytic->plat[2];
+}
+
+/*
+Works out one angle of the formula,
+atan(WIDTH / (2 * HEIGHT) * (positive - negative) / max(positive, negative))
+@param positive - the sum of the two quadrants on the positive side
+@param negative - the sum of the two on the negative side
+@return - the angle in degrees, 0 when both are dark
+*/
+static float getAxisAngle(float positive, float negative) {
+	float larger = positive > negative ? positive : negative;
+
+	// FLT_MIN keeps a dark reading at 0 / FLT_MIN instead of 0 / 0
+	larger = larger > FLT_MIN ? larger : FLT_MIN;
+	return DEGREES * fastAtan(SENSORWIDTH / (2 * SENSORHEIGHT) * (positive - negative) / larger);
+}
@@ -0,0 +1,35 @@
+#ifndef ANALYTIC_H
+#define ANALYTIC_H
+
+#include "calculations.h"
+
+// Geometry readAndCalc in Servo_Lookup_Table_Code assumes: a SENSORWIDTH wide window at
+// SENSORHEIGHT over four quadrants, voltage1 +x+y, voltage2 +x-y, voltage3 -x-y, voltage4 -x+y.
+// In the head frame of sun_vector.h x is the platform's side and y the servo's, so the
+// formula's alpha follows the platform and its beta the servo.
+#define SENSORWIDTH 3.0f
+#define SENSORHEIGHT 1.5f
+
+// Maps the angles of the formula onto the servo and platform angles of one table, as
+// servo = servo[0] * alpha + servo[1] * beta + servo[2] and the same for plat. A rig whose
+// axes are swapped, mirrored or offset from the ideal geometry still gets a usable estimate.
+// rmsError is how far the mapped estimates of the table's own rows are from their angles.
+typedef struct analytic_s {
+	float servo[3];
+	float plat[3];
+	float rmsError;
+} analytic_t;
+
+float fastAtan(float x);
+
+void getAnglesAnalytic(const voltage_t *realVolts, anglef_t *angle);
+
+void getAnglesAnalyticBatch(const voltage_t *realVolts, size_t n, anglef_t *angles);
+
+void initAnalytic(analytic_t *analytic);
+
+int fitAnalytic(analytic_t *analytic, const lookup_table_t *table);
+
+void mapAnalytic(const analytic_t *analytic, const anglef_t *angle, anglef_t *mapped);
+
+#endif
@@ -0,0 +1,92 @@
+#include "batch.h"
+#include <pthread.h>
+#include <unistd.h>
+
+// The slice of a batch handled by one thread
+typedef struct batch_part_s {
+	const lookup_table_t *table;
+	const voltage_t *realVolts;
+	angle_t *angles;
+	int *statuses;
+	size_t count;
+} batch_part_t;
+
+static void *runBatchPart(void *arg);
+
+/*
+Calculates the best angle for many readings, sharing one loaded table across threads
+@param table - the lookup table, only read so it can be shared
+@param realVolts - the voltage readings
+@param n - the number of readings
+@param angles - receives one angle per reading, 0, 0 where nothing matched or it was dark
+@param statuses - receives the getAngles result of each reading, SUN_OK, SUN_NOMATCH or
+SUN_DARK, so a failed reading is not taken for a match at 0, 0; NULL if not wanted
+@param threads - threads to split the readings over, 0 for one per online core
+@return - 0 on success, -1 if the threads could not be started
+*/
+int getAnglesBatch(const lookup_table_t *table, const voltage_t *realVolts, size_t n, angle_t *angles, int *statuses, int threads) {
+	pthread_t ids[MAXTHREADS];
+	batch_part_t parts[MAXTHREADS];
+	size_t start = 0;
+	int started;
+	int status = 0;
+	int i;
+
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	// sysconf gives -1 when it cannot tell, and a count never goes below one
+	if (threads < 1)
+		threads = 1;
+	if ((size_t)threads > n)
+		threads = n;
+	if (threads > MAXTHREADS)
+		threads = MAXTHREADS;
+	if (threads <= 1) {
+		parts[0].table = table;
+		parts[0].realVolts = realVolts;
+		parts[0].angles = angles;
+		parts[0].statuses = statuses;
+		parts[0].count = n;
+		runBatchPart(&parts[0]);
+		return 0;
+	}
+
+	// Give each thread one contiguous slice, the first n % threads get one extra reading
+	for (started = 0; started < threads; started++) {
+		parts[started].table = table;
+		parts[started].realVolts = realVolts + start;
+		parts[started].angles = angles + start;
+		parts[started].statuses = statuses == NULL ? NULL : statuses + start;
+		parts[started].count = n / threads + ((size_t)started < n % threads);
+		start += parts[started].count;
+		if (pthread_create(&ids[started], NULL, runBatchPart, &parts[started]) != 0) {
+			status = -1;
+			break;
+		}
+	}
+	for (i = 0; i < started; i++)
+		pthread_join(ids[i], NULL);
+	return status;
+}
+
+/*
+Matches one slice of a batch
+@param arg - the batch_part_t to work on
+@return - NULL
+*/
+static void *runBatchPart(void *arg) {
+	const batch_part_t *part = arg;
+	size_t i;
+	int status;
+
+	for (i = 0; i < part->count; i++) {
+		status = getAngles(part->table, &part->realVolts[i], &part->angles[i]);
+		if (status != SUN_OK) {
+			part->angles[i].alpha = 0;
+			part->angles[i].beta = 0;
+		}
+		if (part->statuses != NULL)
+			part->statuses[i] = status;
+	}
+	return NULL;
+}
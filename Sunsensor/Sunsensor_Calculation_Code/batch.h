@@ -0,0 +1,11 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "calculations.h"
+
+// Most threads getAnglesBatch will start
+#define MAXTHREADS 64
+
+int getAnglesBatch(const lookup_table_t *table, const voltage_t *realVolts, size_t n, angle_t *angles, int *statuses, int threads);
+
+#endif
@@ -0,0 +1,301 @@
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+#include <unistd.h>
+#include "calculations.h"
+#include "scan.h"
+#include "kdtree.h"
+#include "tracker.h"
+#include "interpolate.h"
+#include "batch.h"
+#include "photomodel.h"
+#include "table_file.h"
+#include "parse_csv.h"
+#include "quant_table.h"
+#include "sun_vector.h"
+#include "sun_heads.h"
+#include "analytic.h"
+
+#define RUNS 10000
+#define PARSERUNS 100
+// Deviation the early exit timings stop at, about the spread between two recordings
+#define BENCHGOODENOUGH 0.05f
+// Readings in one replayed test campaign
+#define CAMPAIGN 3600
+// A second recorded sweep, its rows replayed as readings
+#define RECORDED "lookup_old.txt"
+
+/*
+Returns a monotonic timestamp in nanoseconds
+*/
+static double nowNs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+	const char *filename = argc > 1 ? argv[1] : LOOKUPTABLE;
+	lookup_table_t table;
+	tracker_t tracker;
+	angle_t angle;
+	sun_match_t match;
+	anglef_t fineAngle;
+	photomodel_t model;
+	voltage_t norm;
+	voltage_t darkVolts = { 0, 0, 0, 0 };
+	voltage_t *campaign;
+	lookup_table_t recorded;
+	lookup_table_t headTable;
+	analytic_t analytic;
+	voltage_t *recordedVolts;
+	anglef_t *recordedAngles;
+	quant_table_t quant;
+	sun_heads_t heads;
+	voltage_t headVolts[MAXHEADS];
+	double rotation[3][3];
+	sun_vector_t sun;
+	vector_table_t vectors;
+	uint16_t ratio[4];
+	uint16_t counts[4];
+	anglefx_t fixedAngle;
+	uint32_t quantDev;
+	sweep_row_t *rows;
+	sweep_row_t row;
+	const char *cursor;
+	char *text;
+	size_t rowCount;
+	long bytes = 0;
+	FILE *fp;
+	angle_t *angles;
+	float dev;
+	int threads;
+	size_t sink = 0;
+	double start;
+	int i;
+	int j;
+
+	start = nowNs();
+	if (mapLookupTable(&table, TABLEFILE) == 0) {
+		printf("Mapping %s : %.2f us\n", TABLEFILE, (nowNs() - start) / 1e3);
+		freeLookupTable(&table);
+	}
+
+	start = nowNs();
+	if (initLookupTable(&table, filename) != 0) {
+		printf("Could not read %s\n", filename);
+		return EXIT_FAILURE;
+	}
+	printf("Parsing %s : %.2f us\n", filename, (nowNs() - start) / 1e3);
+
+	// Parse the text already in memory, then again with the read and row arrays included
+	fp = fopen(filename, "rb");
+	if (fp != NULL && fseek(fp, 0, SEEK_END) == 0 && (bytes = ftell(fp)) > 0 && fseek(fp, 0, SEEK_SET) == 0) {
+		text = malloc(bytes + 1);
+		if (text != NULL && fread(text, 1, bytes, fp) == (size_t)bytes) {
+			text[bytes] = '\0';
+			start = nowNs();
+			for (i = 0; i < PARSERUNS; i++) {
+				cursor = text;
+				while (parseSweepRow(&cursor, text + bytes, &row) != CSV_END)
+					sink += row.servo;
+			}
+			printf("CSV parse on one thread : %.0f MB/s\n", bytes * PARSERUNS / ((nowNs() - start) / 1e3));
+		}
+		free(text);
+	}
+	if (fp != NULL)
+		fclose(fp);
+	start = nowNs();
+	for (i = 0; i < PARSERUNS; i++) {
+		if (parseSweepFile(filename, &rows, &rowCount, 1) == 0)
+			free(rows);
+	}
+	printf("CSV file load on one thread : %.0f MB/s\n", bytes * PARSERUNS / ((nowNs() - start) / 1e3));
+
+	start = nowNs();
+	for (i = 0; i < RUNS; i++) {
+		getTableVoltage(&table, i % table.count, &norm);
+		sink += findBestRowScalar(&table, &norm, &dev);
+	}
+	printf("Scalar scan of %zu rows : %.2f us\n", table.count, (nowNs() - start) / RUNS / 1e3);
+
+	start = nowNs();
+	for (i = 0; i < RUNS; i++) {
+		getTableVoltage(&table, i % table.count, &norm);
+		sink += findBestRow(&table, &norm, &dev);
+	}
+	printf("SIMD scan of %zu rows : %.2f us\n", table.count, (nowNs() - start) / RUNS / 1e3);
+
+	if (quantizeTable(&quant, &table) == 0) {
+		start = nowNs();
+		for (i = 0; i < RUNS; i++) {
+			getTableVoltage(&table, i % table.count, &norm);
+			quantizeVoltage(&norm, ratio);
+			sink += findBestQuantRow(&quant, ratio, &quantDev);
+		}
+		printf("Integer scan of %zu quantized rows (%zu bytes) : %.2f us\n", quant.count, quant.count * sizeof(quant_row_t), (nowNs() - start) / RUNS / 1e3);
+
+		// Whole fixed point queries from raw counts against the float interpolation; on the
+		// host both have an FPU, the gap only shows on targets without one
+		start = nowNs();
+		for (i = 0; i < RUNS; i++) {
+			getTableVoltage(&table, i % table.count, &norm);
+			counts[0] = norm.volt1 * 1023;
+			counts[1] = norm.volt2 * 1023;
+			counts[2] = norm.volt3 * 1023;
+			counts[3] = norm.volt4 * 1023;
+			sink += getAnglesInterpQuant(&quant, counts, &fixedAngle);
+		}
+		printf("Fixed point interpolated query : %.2f us\n", (nowNs() - start) / RUNS / 1e3);
+		start = nowNs();
+		for (i = 0; i < RUNS; i++) {
+			getTableVoltage(&table, i % table.count, &norm);
+			sink += getAnglesInterp(&table, &norm, &fineAngle) < 1;
+		}
+		printf("Float interpolated query : %.2f us\n", (nowNs() - start) / RUNS / 1e3);
+		freeQuantTable(&quant);
+	}
+	if (initVectorTable(&vectors, &table) == 0) {
+		start = nowNs();
+		for (i = 0; i < RUNS; i++) {
+			getTableVoltage(&table, i % table.count, &norm);
+			sink += getSensorVector(&table, NULL, &norm, &sun) < 1;
+		}
+		printf("Sun vector through the angles : %.2f us\n", (nowNs() - start) / RUNS / 1e3);
+		start = nowNs();
+		for (i = 0; i < RUNS; i++) {
+			getTableVoltage(&table, i % table.count, &norm);
+			sink += getSensorVector(&table, &vectors, &norm, &sun) < 1;
+		}
+		printf("Sun vector from the row directions : %.2f us\n", (nowNs() - start) / RUNS / 1e3);
+		freeVectorTable(&vectors);
+	}
+
+	start = nowNs();
+	for (i = 0; i < RUNS; i++) {
+		getTableVoltage(&table, i % table.count, &norm);
+		sink += kdFindBestRow(table.index, &norm, &dev);
+	}
+	printf("k-d tree search of %zu rows : %.2f us\n", table.count, (nowNs() - start) / RUNS / 1e3);
+
+	// Readings taken from another row, nudged so they are near rather than on a table row
+	start = nowNs();
+	for (i = 0; i < RUNS; i++) {
+		getTableVoltage(&table, (i * 7) % table.count, &norm);
+		norm.volt1 += 0.01f;
+		sink += findGoodRow(&table, &norm, BENCHGOODENOUGH, &dev);
+	}
+	printf("SIMD scan stopping under %.2f : %.2f us\n", BENCHGOODENOUGH, (nowNs() - start) / RUNS / 1e3);
+	start = nowNs();
+	for (i = 0; i < RUNS; i++) {
+		getTableVoltage(&table, (i * 7) % table.count, &norm);
+		norm.volt1 += 0.01f;
+		sink += kdFindGoodRow(table.index, &norm, BENCHGOODENOUGH, &dev);
+	}
+	printf("k-d tree search stopping under %.2f : %.2f us\n", BENCHGOODENOUGH, (nowNs() - start) / RUNS / 1e3);
+	start = nowNs();
+	for (i = 0; i < RUNS; i++) {
+		getTableVoltage(&table, (i * 7) % table.count, &norm);
+		norm.volt1 += 0.01f;
+		sink += getAngles(&table, &norm, &angle) + angle.alpha;
+	}
+	printf("Nudged query : %.2f us\n", (nowNs() - start) / RUNS / 1e3);
+	start = nowNs();
+	for (i = 0; i < RUNS; i++) {
+		getTableVoltage(&table, (i * 7) % table.count, &norm);
+		norm.volt1 += 0.01f;
+		sink += getAnglesMatch(&table, &norm, &match) + match.second.alpha;
+	}
+	printf("Nudged query with the second match : %.2f us\n", (nowNs() - start) / RUNS / 1e3);
+	start = nowNs();
+	for (i = 0; i < RUNS; i++)
+		sink += getAngles(&table, &darkVolts, &angle) == SUN_DARK;
+	printf("Dark reading : %.3f us\n", (nowNs() - start) / RUNS / 1e3);
+
+	// The table rows are in sweep order, so consecutive rows stand in for a slowly moving sun
+	initTracker(&tracker, &table, TRACKRADIUS, TRACKTHRESHOLD);
+	start = nowNs();
+	for (i = 0; i < RUNS; i++) {
+		getTableVoltage(&table, i % table.count, &norm);
+		sink += trackAngles(&tracker, &norm, &angle) < TRACKTHRESHOLD;
+	}
+	printf("Tracked search of %zu rows : %.2f us\n", table.count, (nowNs() - start) / RUNS / 1e3);
+
+	// The analytic estimate against the table on the readings of another sweep
+	if (initLookupTable(&recorded, RECORDED) == 0 && fitAnalytic(&analytic, &table) == 0) {
+		recordedVolts = malloc(recorded.count * sizeof(voltage_t));
+		recordedAngles = malloc(recorded.count * sizeof(anglef_t));
+		for (i = 0; i < recorded.count; i++)
+			getTableVoltage(&recorded, i, &recordedVolts[i]);
+		start = nowNs();
+		for (i = 0; i < RUNS; i++)
+			sink += getAngles(&table, &recordedVolts[i % recorded.count], &angle) + angle.alpha;
+		printf("Query of %s : %.2f us\n", RECORDED, (nowNs() - start) / RUNS / 1e3);
+		start = nowNs();
+		for (i = 0; i < RUNS; i++) {
+			getAnglesAnalytic(&recordedVolts[i % recorded.count], &fineAngle);
+			sink += fineAngle.alpha > 0;
+		}
+		printf("Analytic estimate of %s : %.3f us\n", RECORDED, (nowNs() - start) / RUNS / 1e3);
+		start = nowNs();
+		for (i = 0; i < RUNS / 100; i++) {
+			getAnglesAnalyticBatch(recordedVolts, recorded.count, recordedAngles);
+			sink += recordedAngles[i % recorded.count].alpha > 0;
+		}
+		printf("Analytic batch of %zu readings : %.4f us a reading\n", recorded.count, (nowNs() - start) / (RUNS / 100) / recorded.count / 1e3);
+		free(recordedVolts);
+		free(recordedAngles);
+		freeLookupTable(&recorded);
+	}
+
+	// Every face gets a head mapped from the compiled table and a reading of its own
+	initSunHeads(&heads);
+	for (i = 0; i < MAXHEADS; i++) {
+		getFaceRotation(i, rotation);
+		if (loadLookupTable(&headTable, TABLEFILE) == 0 && addSunHead(&heads, &headTable, rotation) < 0)
+			freeLookupTable(&headTable);
+	}
+	if (heads.count == MAXHEADS) {
+		start = nowNs();
+		for (i = 0; i < RUNS; i++) {
+			for (j = 0; j < MAXHEADS; j++)
+				getTableVoltage(&table, (i * 7 + j * 600) % table.count, &headVolts[j]);
+			sink += getSunVector(&heads, headVolts, &sun, NULL) + (sun.z > 0);
+		}
+		printf("Sun vector from %d heads : %.2f us\n", MAXHEADS, (nowNs() - start) / RUNS / 1e3);
+	}
+	freeSunHeads(&heads);
+
+	if (loadPhotoModel(&model, MODELFILE) == 0) {
+		start = nowNs();
+		for (i = 0; i < RUNS; i++) {
+			getTableVoltage(&table, i % table.count, &norm);
+			sink += getAnglesModel(&model, &table, &norm, NULL, &fineAngle);
+		}
+		printf("Model inversion from the seed grid : %.2f us\n", (nowNs() - start) / RUNS / 1e3);
+		start = nowNs();
+		for (i = 0; i < RUNS; i++) {
+			getTableVoltage(&table, i % table.count, &norm);
+			sink += getAnglesModel(&model, &table, &norm, &fineAngle, &fineAngle);
+		}
+		printf("Model inversion seeded with the last angle : %.2f us\n", (nowNs() - start) / RUNS / 1e3);
+	}
+
+	campaign = malloc(CAMPAIGN * sizeof(voltage_t));
+	angles = malloc(CAMPAIGN * sizeof(angle_t));
+	for (i = 0; i < CAMPAIGN; i++) {
+		getTableVoltage(&table, i % table.count, &campaign[i]);
+		campaign[i].volt1 += 0.01f * (i % 3);
+	}
+	for (threads = 1; threads <= sysconf(_SC_NPROCESSORS_ONLN); threads *= 2) {
+		start = nowNs();
+		for (i = 0; i < RUNS / 100; i++)
+			getAnglesBatch(&table, campaign, CAMPAIGN, angles, NULL, threads);
+		printf("Batch of %d readings on %d threads : %.2f us\n", CAMPAIGN, threads, (nowNs() - start) / (RUNS / 100) / 1e3);
+	}
+	free(campaign);
+	free(angles);
+
+	freeLookupTable(&table);
+	return sink == 0;
+}
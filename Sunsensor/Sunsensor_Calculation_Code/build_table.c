@@ -0,0 +1,212 @@
+#include "calculations.h"
+#include "table_file.h"
+#include "parse_csv.h"
+#include <string.h>
+#include <unistd.h>
+
+// Cells cover servo and platform angles from -MAXANGLE to MAXANGLE, whatever the log length
+#define MAXANGLE 90
+#define GRIDSIDE (2 * MAXANGLE + 1)
+// A reading with any channel at or above this is clipped and dropped. analogRead tops out at 1023.
+#define SATURATION 1023
+
+// Running totals for one servo/platform cell. Ratios are summed rather than raw voltages so
+// visits at different light levels count equally.
+typedef struct cell_sum_s {
+	double ratio[4];
+	unsigned long visits;
+} cell_sum_t;
+
+// Counts of what happened to the lines of the logs, printed at the end
+typedef struct build_stats_s {
+	unsigned long readings;
+	unsigned long malformed;
+	unsigned long saturated;
+	unsigned long outside;
+} build_stats_t;
+
+static int readSweepLog(FILE *fp, cell_sum_t *cells, double saturation, build_stats_t *stats);
+static int fillTable(lookup_table_t *table, const cell_sum_t *cells, unsigned long minVisits);
+
+/*
+Builds a lookup table straight from raw sweep logs in the sens,plat,v1,v2,v3,v4 format the
+Servo_Lookup_Table_Code sketch prints and Data_Processing_Code captures. Repeated visits to
+a cell are averaged and saturated readings dropped, in one streaming pass whose memory does
+not grow with the log. The table is written as lookup.txt text, a C header or lookup.bin
+depending on the output name.
+usage: build_table [-s saturation] [-m minvisits] -o <output.txt|output.h|output.bin> <log> [log...]
+  -s  drop readings with a channel at or above this, default SATURATION
+  -m  leave out cells visited fewer times than this, default 1
+  -o  the table to write
+A log named - is read from standard input.
+*/
+int main(int argc, char *argv[]) {
+	cell_sum_t *cells;
+	build_stats_t stats;
+	lookup_table_t table;
+	const char *output = NULL;
+	double saturation = SATURATION;
+	unsigned long minVisits = 1;
+	size_t length;
+	FILE *fp;
+	int option;
+	int status;
+	int i;
+
+	while ((option = getopt(argc, argv, "s:m:o:")) != -1) {
+		if (option == 's')
+			saturation = atof(optarg);
+		else if (option == 'm')
+			minVisits = strtoul(optarg, NULL, 10);
+		else if (option == 'o')
+			output = optarg;
+		else
+			optind = argc + 1;
+	}
+	if (output == NULL || optind >= argc) {
+		fprintf(stderr, "usage: %s [-s saturation] [-m minvisits] -o <output.txt|output.h|output.bin> <log> [log...]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	cells = calloc((size_t)GRIDSIDE * GRIDSIDE, sizeof(cell_sum_t));
+	if (cells == NULL)
+		return EXIT_FAILURE;
+	memset(&stats, 0, sizeof(stats));
+	for (i = optind; i < argc; i++) {
+		fp = strcmp(argv[i], "-") == 0 ? stdin : fopen(argv[i], "r");
+		if (fp == NULL) {
+			fprintf(stderr, "Could not read %s\n", argv[i]);
+			free(cells);
+			return EXIT_FAILURE;
+		}
+		status = readSweepLog(fp, cells, saturation, &stats);
+		if (fp != stdin)
+			fclose(fp);
+		if (status != 0) {
+			fprintf(stderr, "Could not read %s\n", argv[i]);
+			free(cells);
+			return EXIT_FAILURE;
+		}
+	}
+	status = fillTable(&table, cells, minVisits);
+	free(cells);
+	if (status != 0) {
+		fprintf(stderr, "No cells to build a table from\n");
+		return EXIT_FAILURE;
+	}
+
+	length = strlen(output);
+	if (length > 4 && strcmp(output + length - 4, ".txt") == 0)
+		status = writeTableText(&table, output);
+	else if (length > 2 && strcmp(output + length - 2, ".h") == 0)
+		status = writeTableSource(&table, output, argv[optind]);
+	else
+		status = writeTableFile(&table, output);
+	if (status != 0) {
+		fprintf(stderr, "Could not write %s\n", output);
+		freeLookupTable(&table);
+		return EXIT_FAILURE;
+	}
+	printf("Read %lu readings, dropped %lu malformed lines, %lu saturated, %lu outside +-%d degrees\n",
+		stats.readings, stats.malformed, stats.saturated, stats.outside, MAXANGLE);
+	printf("Built %zu rows (%d x %d grid) into %s\n", table.count, table.servoCount, table.platCount, output);
+	freeLookupTable(&table);
+	return EXIT_SUCCESS;
+}
+
+/*
+Adds every reading of one sweep log to the cell totals
+@param fp - the open log
+@param cells - GRIDSIDE x GRIDSIDE totals, indexed by platform then servo
+@param saturation - readings with a channel at or above this are dropped
+@param stats - counts to add to
+@return - 0 on success, -1 on a read error or if out of memory
+*/
+static int readSweepLog(FILE *fp, cell_sum_t *cells, double saturation, build_stats_t *stats) {
+	sweep_reader_t reader;
+	sweep_row_t row;
+	cell_sum_t *cell;
+	float volts[4];
+	double sum;
+	int servo;
+	int plat;
+	int status;
+	int i;
+
+	if (openSweepReader(&reader, fp) != 0)
+		return -1;
+	while ((status = nextSweepRow(&reader, &row)) != CSV_END) {
+		if (status == CSV_MALFORMED) {
+			stats->malformed++;
+			continue;
+		}
+		servo = row.servo;
+		plat = row.plat;
+		volts[0] = row.volts.volt1;
+		volts[1] = row.volts.volt2;
+		volts[2] = row.volts.volt3;
+		volts[3] = row.volts.volt4;
+		if (servo < -MAXANGLE || servo > MAXANGLE || plat < -MAXANGLE || plat > MAXANGLE) {
+			stats->outside++;
+			continue;
+		}
+		if (volts[0] >= saturation || volts[1] >= saturation || volts[2] >= saturation || volts[3] >= saturation) {
+			stats->saturated++;
+			continue;
+		}
+		sum = (double)volts[0] + volts[1] + volts[2] + volts[3];
+		if (!(sum > 0)) {
+			stats->malformed++;
+			continue;
+		}
+		cell = &cells[(plat + MAXANGLE) * GRIDSIDE + servo + MAXANGLE];
+		for (i = 0; i < 4; i++)
+			cell->ratio[i] += volts[i] / sum;
+		cell->visits++;
+		stats->readings++;
+	}
+	closeSweepReader(&reader);
+	return ferror(fp) ? -1 : 0;
+}
+
+/*
+Makes a table with one row per visited cell, holding the mean ratios of its readings
+@param table - the table to fill, released with freeLookupTable
+@param cells - the totals from readSweepLog
+@param minVisits - cells visited fewer times are left out
+@return - 0 on success, -1 if out of memory or no cell qualified
+*/
+static int fillTable(lookup_table_t *table, const cell_sum_t *cells, unsigned long minVisits) {
+	voltage_t mean;
+	size_t count = 0;
+	size_t row = 0;
+	size_t i;
+
+	if (minVisits < 1)
+		minVisits = 1;
+	for (i = 0; i < (size_t)GRIDSIDE * GRIDSIDE; i++) {
+		if (cells[i].visits >= minVisits)
+			count++;
+	}
+	memset(table, 0, sizeof(lookup_table_t));
+	if (count == 0 || allocLookupTable(table, count) != 0)
+		return -1;
+	for (i = 0; i < (size_t)GRIDSIDE * GRIDSIDE; i++) {
+		if (cells[i].visits < minVisits)
+			continue;
+		// The means of normalized ratios already sum to one, this only tidies the rounding
+		mean.volt1 = cells[i].ratio[0] / cells[i].visits;
+		mean.volt2 = cells[i].ratio[1] / cells[i].visits;
+		mean.volt3 = cells[i].ratio[2] / cells[i].visits;
+		mean.volt4 = cells[i].ratio[3] / cells[i].visits;
+		normalizeVoltage(&mean, &mean);
+		table->servo[row] = (int)(i % GRIDSIDE) - MAXANGLE;
+		table->plat[row] = (int)(i / GRIDSIDE) - MAXANGLE;
+		table->volt1[row] = mean.volt1;
+		table->volt2[row] = mean.volt2;
+		table->volt3[row] = mean.volt3;
+		table->volt4[row] = mean.volt4;
+		row++;
+	}
+	return indexLookupTable(table);
+}
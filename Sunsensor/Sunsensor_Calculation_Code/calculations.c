@@ -1,44 +1,350 @@
 #include "calculations.h"
-#define MAXBYTES 256
-#define MAXVOLTDIFF 4
-#define LOOKUPTABLE "lookup.txt"
-
-/*
-Calculates the best angle based on a lookup table
-@param realvolts - a voltage struct with the voltage readings
-@return - an angle struct closest corresponding to the input
-*/
-angle_t *getAngles(voltage_t *realVolts) {
-	float best = 4;
-	float current;
-	int servo;
-	int plat;
-	angle_t *currentAngle = malloc(sizeof(angle_t));
-	voltage_t *lookVolts = malloc(sizeof(voltage_t));
-	
-	fp = fopen(LOOKUPTABLE, "r");
-	if (fp == NULL)
-		exit(EXIT_FAILURE);
-
-	while (fscanf(fp, "%d,%d,%f,%f,%f,%f,", &servo, &plat, &lookVolts->volt1, &lookVolts->volt2, &lookVolts->volt3, &lookVolts->volt4) != EOF) {
-		
-		//fflush(stdout);
-		// Calculates the deviation between these two voltges
-		current = getDeviation(realVolts, lookVolts);
-		//printf("current: %f", current);
-		// replace the best angle if it has a lower deviation
-		if (current < best) {
-			currentAngle->alpha = servo;
-			currentAngle->beta = plat;
-			best = current;
-			printf("New Best: %f at:", best);
-			printf("Read: %d,%d,%f,%f,%f,%f\n", servo, plat, lookVolts->volt1, lookVolts->volt2, lookVolts->volt3, lookVolts->volt4);
+#include "scan.h"
+#include "kdtree.h"
+#include <string.h>
+#ifdef __unix__
+#include <sys/mman.h>
+#endif
+// Filler value for the padding rows, far enough from any ratio that they never match
+#define PADVOLT 1e30f
+
+static int buildGrid(lookup_table_t *table);
+static int areFarRows(const lookup_table_t *table, size_t a, size_t b);
+
+/*
+Builds the k-d tree, unless one was already loaded, and the angle grid once the table
+columns are filled in, and gives the table the default match limits
+@param table - the table to index, released again if this fails
+@return - 0 on success, -1 if out of memory
+*/
+int indexLookupTable(lookup_table_t *table) {
+	setMatchLimits(table, DARKSUM, GOODENOUGH);
+	if (table->index == NULL)
+		table->index = buildKdTree(table);
+	if (table->index == NULL || buildGrid(table) != 0) {
+		freeLookupTable(table);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+Builds the map from servo/platform angle to table row
+@param table - the table with its columns filled in
+@return - 0 on success, -1 if out of memory
+*/
+static int buildGrid(lookup_table_t *table) {
+	int servoMax = 0;
+	int platMax = 0;
+	int cell;
+	size_t i;
+
+	table->servoMin = table->platMin = 0;
+	for (i = 0; i < table->count; i++) {
+		if (i == 0 || table->servo[i] < table->servoMin)
+			table->servoMin = table->servo[i];
+		if (i == 0 || table->servo[i] > servoMax)
+			servoMax = table->servo[i];
+		if (i == 0 || table->plat[i] < table->platMin)
+			table->platMin = table->plat[i];
+		if (i == 0 || table->plat[i] > platMax)
+			platMax = table->plat[i];
+	}
+	table->servoCount = servoMax - table->servoMin + 1;
+	table->platCount = platMax - table->platMin + 1;
+	table->grid = malloc((size_t)table->servoCount * table->platCount * sizeof(int));
+	if (table->grid == NULL)
+		return -1;
+	for (i = 0; i < (size_t)table->servoCount * table->platCount; i++)
+		table->grid[i] = -1;
+	// Keep the first row for an angle that appears twice, as the scan would
+	for (i = 0; i < table->count; i++) {
+		cell = (table->plat[i] - table->platMin) * table->servoCount + table->servo[i] - table->servoMin;
+		if (table->grid[cell] < 0)
+			table->grid[cell] = i;
+	}
+	return 0;
+}
+
+/*
+Allocates aligned, padded columns for a table and fills the padding rows. The caller fills
+in the real rows, normalized, then calls indexLookupTable.
+@param table - the table to allocate columns for
+@param count - the number of real rows
+@return - 0 on success, -1 if out of memory
+*/
+int allocLookupTable(lookup_table_t *table, size_t count) {
+	size_t padded = (count + TABLEPAD - 1) / TABLEPAD * TABLEPAD;
+	size_t i;
+
+	table->count = count;
+	table->padded = padded;
+	table->storageSize = getColumnsSize(padded);
+	// Never ask for zero bytes so an empty table still gets valid storage
+	table->storage = aligned_alloc(TABLEALIGN, table->storageSize + TABLEALIGN);
+	if (table->storage == NULL)
+		return -1;
+	table->storageKind = TABLE_HEAP;
+	setTableColumns(table, table->storage);
+	for (i = count; i < padded; i++) {
+		table->servo[i] = 0;
+		table->plat[i] = 0;
+		table->volt1[i] = PADVOLT;
+		table->volt2[i] = PADVOLT;
+		table->volt3[i] = PADVOLT;
+		table->volt4[i] = PADVOLT;
+	}
+	return 0;
+}
+
+/*
+Gives the bytes needed for all six columns of a table
+@param padded - the padded row count
+@return - the size of the column storage
+*/
+size_t getColumnsSize(size_t padded) {
+	return padded * (2 * sizeof(int) + 4 * sizeof(float));
+}
+
+/*
+Points the table columns into one block laid out as servo, plat, volt1..volt4
+@param table - the table, with padded already set
+@param base - the start of the block, aligned to TABLEALIGN
+*/
+void setTableColumns(lookup_table_t *table, void *base) {
+	char *column = base;
+	table->servo = (int *)column;
+	column += table->padded * sizeof(int);
+	table->plat = (int *)column;
+	column += table->padded * sizeof(int);
+	table->volt1 = (float *)column;
+	column += table->padded * sizeof(float);
+	table->volt2 = (float *)column;
+	column += table->padded * sizeof(float);
+	table->volt3 = (float *)column;
+	column += table->padded * sizeof(float);
+	table->volt4 = (float *)column;
+}
+
+/*
+Releases the memory held by a lookup table
+@param table - a table filled by initLookupTable, mapLookupTable or initStaticTable
+*/
+void freeLookupTable(lookup_table_t *table) {
+	if (table->storageKind == TABLE_HEAP)
+		free(table->storage);
+#ifdef __unix__
+	else if (table->storageKind == TABLE_MAPPED)
+		munmap(table->storage, table->storageSize);
+#endif
+	freeKdTree(table->index);
+	free(table->grid);
+	memset(table, 0, sizeof(lookup_table_t));
+}
+
+/*
+Sets when a reading counts as no sun and when a search may stop before the best row
+@param table - the lookup table
+@param darkSum - readings whose four voltages sum to no more than this are dark, in the
+units of the readings
+@param goodEnough - a search may return the first row found with a deviation under this
+instead of the best one, 0 to always find the best
+*/
+void setMatchLimits(lookup_table_t *table, float darkSum, float goodEnough) {
+	table->darkSum = darkSum;
+	table->goodEnough = goodEnough;
+}
+
+/*
+Checks whether a reading is too dim to hold the sun, such as in eclipse
+@param table - the lookup table, for its dark limit
+@param realVolts - the voltage readings
+@return - 1 if the readings sum to no more than the dark limit, or are not numbers
+*/
+int isDark(const lookup_table_t *table, const voltage_t *realVolts) {
+	float sum = realVolts->volt1 + realVolts->volt2 + realVolts->volt3 + realVolts->volt4;
+	return !(sum > table->darkSum);
+}
+
+/*
+Checks whether a reading holds an infinity or not a number, as a broken ADC or a bad
+conversion can give. Normalizing one would give deviations that are not numbers, which no
+search can rank.
+@param realVolts - the voltage readings
+@return - 1 if any voltage is not finite, otherwise 0
+*/
+int isBadReading(const voltage_t *realVolts) {
+	return !isfinite(realVolts->volt1) || !isfinite(realVolts->volt2) || !isfinite(realVolts->volt3) || !isfinite(realVolts->volt4);
+}
+
+/*
+Calculates the best angle based on a lookup table. Uses no heap and no shared state, so it
+is safe to call from several threads on the same table.
+@param table - the lookup table loaded with initLookupTable
+@param realVolts - a voltage struct with the voltage readings
+@param angle - receives the angle closest corresponding to the input
+@return - SUN_OK, SUN_DARK if the reading is too dim or SUN_NOMATCH if no row matched or
+the reading is not finite, angle is unchanged unless SUN_OK
+*/
+int getAngles(const lookup_table_t *table, const voltage_t *realVolts, angle_t *angle) {
+	float best;
+	size_t row;
+	voltage_t realNorm;
+
+	if (isBadReading(realVolts))
+		return SUN_NOMATCH;
+	// Checked before normalizing, which would divide by a sum of about zero
+	if (isDark(table, realVolts))
+		return SUN_DARK;
+	// The table rows are already normalized, so only the reading needs it
+	normalizeVoltage(realVolts, &realNorm);
+	row = findBestMatch(table, &realNorm, &best);
+	if (row >= table->count)
+		return SUN_NOMATCH;
+	angle->alpha = table->servo[row];
+	angle->beta = table->plat[row];
+	return SUN_OK;
+}
+
+/*
+Finds the best row for a normalized reading, through the k-d tree when the table has one.
+Stops early at a row under the table's good enough limit if one is set.
+@param table - the lookup table
+@param norm - the normalized voltage reading
+@param bestDev - receives the deviation of the row returned
+@return - the index of the best row, or table->count if no row is under MAXVOLTDIFF
+*/
+size_t findBestMatch(const lookup_table_t *table, const voltage_t *norm, float *bestDev) {
+	if (table->index != NULL)
+		return kdFindGoodRow(table->index, norm, table->goodEnough, bestDev);
+	return findGoodRow(table, norm, table->goodEnough, bestDev);
+}
+
+/*
+Calculates the best angle along with the best angle outside ALIASRADIUS of it, both from
+the one search
+@param table - the lookup table
+@param realVolts - the voltage readings
+@param match - receives both matches and their deviations, unchanged unless SUN_OK
+@return - SUN_OK, SUN_DARK if the reading is too dim or SUN_NOMATCH if no row matched or
+the reading is not finite
+*/
+int getAnglesMatch(const lookup_table_t *table, const voltage_t *realVolts, sun_match_t *match) {
+	match_rows_t kept;
+	voltage_t realNorm;
+
+	if (isBadReading(realVolts))
+		return SUN_NOMATCH;
+	if (isDark(table, realVolts))
+		return SUN_DARK;
+	normalizeVoltage(realVolts, &realNorm);
+	if (table->index != NULL)
+		kdFindMatchRows(table->index, table, &realNorm, &kept);
+	else
+		findMatchRowsScalar(table, &realNorm, &kept);
+	return getMatchRows(table, &kept, match);
+}
+
+/*
+Picks the best and second match out of the candidates of a search
+@param table - the lookup table searched
+@param kept - the candidates
+@param match - receives both matches, unchanged unless SUN_OK
+@return - SUN_OK or SUN_NOMATCH if there were no candidates
+*/
+int getMatchRows(const lookup_table_t *table, const match_rows_t *kept, sun_match_t *match) {
+	size_t best;
+	size_t i;
+
+	if (kept->found == 0)
+		return SUN_NOMATCH;
+	best = kept->rows[0];
+	match->best.alpha = match->second.alpha = table->servo[best];
+	match->best.beta = match->second.beta = table->plat[best];
+	match->bestDev = kept->devs[0];
+	match->secondDev = MAXVOLTDIFF;
+	// The candidates are in order, so the first one far enough away is the second match
+	for (i = 1; i < kept->found; i++) {
+		if (abs(table->servo[kept->rows[i]] - match->best.alpha) > ALIASRADIUS || abs(table->plat[kept->rows[i]] - match->best.beta) > ALIASRADIUS) {
+			match->second.alpha = table->servo[kept->rows[i]];
+			match->second.beta = table->plat[kept->rows[i]];
+			match->secondDev = kept->devs[i];
+			break;
 		}
 	}
-	fclose(fp);
-	if (line)
-		free(line);
-	return(currentAngle);
+	return SUN_OK;
+}
+
+/*
+Tells whether two rows are too far apart to both be near the same best match
+@param table - the lookup table
+@param a - the first row
+@param b - the second row
+@return - 1 if they are more than 2 * ALIASRADIUS apart on either axis, otherwise 0
+*/
+static int areFarRows(const lookup_table_t *table, size_t a, size_t b) {
+	return abs(table->servo[a] - table->servo[b]) > 2 * ALIASRADIUS || abs(table->plat[a] - table->plat[b]) > 2 * ALIASRADIUS;
+}
+
+/*
+Adds a row to the candidates of a search for the best and second match if it can still be
+either one, then cuts the list after the first row far from an earlier one
+@param table - the lookup table searched
+@param kept - the candidates, found 0 and bound MAXVOLTDIFF to start
+@param row - the row to add
+@param dev - its deviation
+*/
+void keepMatchRow(const lookup_table_t *table, match_rows_t *kept, size_t row, float dev) {
+	size_t i = kept->found;
+	size_t j;
+	size_t k;
+	int far;
+
+	// A tie with the bound is only kept ahead of a later row, and a deviation that is not a
+	// number fails every comparison so is never kept
+	if (!(dev <= kept->bound) || (dev == kept->bound && (i == 0 || row > kept->rows[i - 1])))
+		return;
+	if (i == ALIASROWS)
+		i--;
+	else
+		kept->found++;
+	for (; i > 0 && (kept->devs[i - 1] > dev || (kept->devs[i - 1] == dev && kept->rows[i - 1] > row)); i--) {
+		kept->devs[i] = kept->devs[i - 1];
+		kept->rows[i] = kept->rows[i - 1];
+	}
+	kept->devs[i] = dev;
+	kept->rows[i] = row;
+	// Rows before the new one have no far pair, so the cut can only come at the new row, at a
+	// later row far from it, or at the last row if the list had been cut there already
+	for (j = i; j < kept->found; j++) {
+		if (j == i || j == kept->found - 1) {
+			for (k = 0; k < j && !areFarRows(table, kept->rows[k], kept->rows[j]); k++);
+			far = k < j;
+		}
+		else {
+			far = areFarRows(table, kept->rows[i], kept->rows[j]);
+		}
+		if (far) {
+			kept->found = j + 1;
+			kept->bound = kept->devs[j];
+			return;
+		}
+	}
+	if (kept->found == ALIASROWS)
+		kept->bound = kept->devs[ALIASROWS - 1];
+}
+
+/*
+Copies one row of normalized voltages out of the table columns
+@param table - the lookup table
+@param row - index of the row, less than table->count
+@param norm - receives the normalized voltages of that row
+*/
+void getTableVoltage(const lookup_table_t *table, size_t row, voltage_t *norm) {
+	norm->volt1 = table->volt1[row];
+	norm->volt2 = table->volt2[row];
+	norm->volt3 = table->volt3[row];
+	norm->volt4 = table->volt4[row];
 }
 
 /*
@@ -47,13 +353,54 @@ Calculates the deviation between two sets of voltage values
 @param lookVolts - the second voltage struct
 @return - a float between 0 and 4 indicating the deviation
 */
-float getDeviation(voltage_t *realVolts, voltage_t *lookVolts) {
-	float realSum = realVolts->volt1 + realVolts->volt2 + realVolts->volt3 + realVolts->volt4;
-	float lookSum = lookVolts->volt1 + lookVolts->volt2 + lookVolts->volt3 + lookVolts->volt4;
+float getDeviation(const voltage_t *realVolts, const voltage_t *lookVolts) {
+	voltage_t realNorm;
+	voltage_t lookNorm;
+	normalizeVoltage(realVolts, &realNorm);
+	normalizeVoltage(lookVolts, &lookNorm);
+	return getNormDeviation(&realNorm, &lookNorm);
+}
+
+/*
+Divides each voltage by the sum of all four so readings of different intensity compare
+@param volts - the raw voltage readings
+@param norm - receives the normalized voltages, may be the same struct as volts
+@return - the sum of the raw voltages
+*/
+float normalizeVoltage(const voltage_t *volts, voltage_t *norm) {
+	float sum = volts->volt1 + volts->volt2 + volts->volt3 + volts->volt4;
+	norm->volt1 = volts->volt1 / sum;
+	norm->volt2 = volts->volt2 / sum;
+	norm->volt3 = volts->volt3 / sum;
+	norm->volt4 = volts->volt4 / sum;
+	return sum;
+}
+
+/*
+Calculates the deviation between two sets of already normalized voltage values
+@param realNorm - the first normalized voltage struct
+@param lookNorm - the second normalized voltage struct
+@return - a float between 0 and 2 indicating the deviation
+*/
+float getNormDeviation(const voltage_t *realNorm, const voltage_t *lookNorm) {
 	return
-		fabs(realVolts->volt1 / realSum - lookVolts->volt1 / lookSum) +
-		fabs(realVolts->volt2 / realSum - lookVolts->volt2 / lookSum) +
-		fabs(realVolts->volt3 / realSum - lookVolts->volt3 / lookSum) +
-		fabs(realVolts->volt4 / realSum - lookVolts->volt4 / lookSum);
+		fabsf(realNorm->volt1 - lookNorm->volt1) +
+		fabsf(realNorm->volt2 - lookNorm->volt2) +
+		fabsf(realNorm->volt3 - lookNorm->volt3) +
+		fabsf(realNorm->volt4 - lookNorm->volt4);
 }
 
+/*
+Finds the table row recorded at a servo/platform angle
+@param table - the lookup table
+@param servo - the servo angle
+@param plat - the platform angle
+@return - the row index, or -1 if the table has no row at that angle
+*/
+int getGridRow(const lookup_table_t *table, int servo, int plat) {
+	servo -= table->servoMin;
+	plat -= table->platMin;
+	if (servo < 0 || servo >= table->servoCount || plat < 0 || plat >= table->platCount)
+		return -1;
+	return table->grid[plat * table->servoCount + servo];
+}
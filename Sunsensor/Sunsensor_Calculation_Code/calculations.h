@@ -1,19 +1,52 @@
+#ifndef CALCULATIONS_H
+#define CALCULATIONS_H
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 
-#define LOOKUP lookup.txt
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOOKUPTABLE "lookup.txt"
+#define MAXVOLTDIFF 4
 
-FILE * fp;
-char * line = NULL;
-size_t len = 0;
-ssize_t read;
+// Results of a sun angle query
+#define SUN_OK 0
+#define SUN_NOMATCH -1
+#define SUN_DARK -2
+// Default match limits given to every loaded table, see setMatchLimits. Readings summing to
+// no more than DARKSUM are no sun, and GOODENOUGH 0 means always search for the best row.
+#define DARKSUM 0.0f
+#define GOODENOUGH 0.0f
+// Rows further than this many degrees from the best match, on either axis, count as a
+// separate match such as a reflection or albedo alias
+#define ALIASRADIUS 2
+// Most candidates kept while matching: every row of the best match's neighbourhood plus one,
+// so the best row outside it is always among them
+#define ALIASROWS ((2 * ALIASRADIUS + 1) * (2 * ALIASRADIUS + 1) + 1)
+// Columns are padded to a multiple of TABLEPAD rows and aligned to TABLEALIGN bytes
+#define TABLEPAD 8
+#define TABLEALIGN 32
+
+// Where the column storage of a table came from, and so how it is released
+#define TABLE_NONE 0
+#define TABLE_HEAP 1
+#define TABLE_MAPPED 2
+#define TABLE_STATIC 3
 
 typedef struct angle_s {
 	int alpha;
 	int beta;
 } angle_t;
 
+// Angles between the table grid points, from interpolating around the best match
+typedef struct anglef_s {
+	float alpha;
+	float beta;
+} anglef_t;
+
 typedef struct voltage_s {
 	float volt1;
 	float volt2;
@@ -21,6 +54,95 @@ typedef struct voltage_s {
 	float volt4;
 } voltage_t;
 
-angle_t *getAngles(voltage_t *realVolts);
+// The best match for a reading and the best match away from it. A second deviation close to
+// the first means the reading is ambiguous; secondDev is MAXVOLTDIFF if there is no second.
+typedef struct sun_match_s {
+	angle_t best;
+	float bestDev;
+	angle_t second;
+	float secondDev;
+} sun_match_t;
+
+// Candidate rows of a search for the best and second match, in order of deviation with ties
+// in row order. Once two of them are more than 2 * ALIASRADIUS apart, one of those two is
+// far enough from any best match to be a second, so the list is cut there and bound drops
+// to the deviation of the last row. Rows above bound can be skipped.
+typedef struct match_rows_s {
+	size_t rows[ALIASROWS];
+	float devs[ALIASROWS];
+	size_t found;
+	float bound;
+} match_rows_t;
+
+struct kdtree_s;
+
+// The whole lookup table, loaded once and kept in memory between queries.
+// Stored as columns: row i is servo[i], plat[i] and the voltages volt1[i]..volt4[i],
+// normalized (each voltage divided by the sum of all four). Rows from count up to
+// padded are filler that can never be the best match. All six columns live in one
+// block, storage, laid out in that order. index is a k-d tree over the rows built at
+// load time, and grid maps a servo/platform angle back to its row. darkSum and goodEnough
+// are the limits set by setMatchLimits.
+typedef struct lookup_table_s {
+	int *servo;
+	int *plat;
+	float *volt1;
+	float *volt2;
+	float *volt3;
+	float *volt4;
+	size_t count;
+	size_t padded;
+	void *storage;
+	size_t storageSize;
+	int storageKind;
+	struct kdtree_s *index;
+	int *grid;
+	int servoMin;
+	int platMin;
+	int servoCount;
+	int platCount;
+	float darkSum;
+	float goodEnough;
+} lookup_table_t;
+
+void freeLookupTable(lookup_table_t *table);
+
+int allocLookupTable(lookup_table_t *table, size_t count);
+
+int indexLookupTable(lookup_table_t *table);
+
+size_t getColumnsSize(size_t padded);
+
+void setTableColumns(lookup_table_t *table, void *base);
+
+void setMatchLimits(lookup_table_t *table, float darkSum, float goodEnough);
+
+int isDark(const lookup_table_t *table, const voltage_t *realVolts);
+
+int isBadReading(const voltage_t *realVolts);
+
+int getAngles(const lookup_table_t *table, const voltage_t *realVolts, angle_t *angle);
+
+size_t findBestMatch(const lookup_table_t *table, const voltage_t *norm, float *bestDev);
+
+int getAnglesMatch(const lookup_table_t *table, const voltage_t *realVolts, sun_match_t *match);
+
+void keepMatchRow(const lookup_table_t *table, match_rows_t *kept, size_t row, float dev);
+
+int getMatchRows(const lookup_table_t *table, const match_rows_t *kept, sun_match_t *match);
+
+float getDeviation(const voltage_t *realVolts, const voltage_t *lookVolts);
+
+float normalizeVoltage(const voltage_t *volts, voltage_t *norm);
+
+float getNormDeviation(const voltage_t *realNorm, const voltage_t *lookNorm);
+
+void getTableVoltage(const lookup_table_t *table, size_t row, voltage_t *norm);
+
+int getGridRow(const lookup_table_t *table, int servo, int plat);
+
+#ifdef __cplusplus
+}
+#endif
 
-float getDeviation(voltage_t *realVolts, voltage_t *lookVolts);
\ No newline at end of file
+#endif
@@ -0,0 +1,53 @@
+#include "calculations.h"
+#include "table_file.h"
+#include "quant_table.h"
+
+#include <string.h>
+
+/*
+Compiles a text lookup table (lookup.txt or lookup_old.txt) into the binary table format,
+or into a C header of const data when the output name ends in .h. With -q the header holds
+the 10 byte quantized rows instead.
+usage: compile_table [-q] <input.txt> <output.bin|output.h>
+*/
+int main(int argc, char *argv[]) {
+	lookup_table_t table;
+	quant_table_t quant;
+	const char *input;
+	const char *output;
+	size_t length;
+	int quantized = argc == 4 && strcmp(argv[1], "-q") == 0;
+	int status;
+
+	if (argc != 3 + quantized) {
+		fprintf(stderr, "usage: %s [-q] <input.txt> <output.bin|output.h>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	input = argv[1 + quantized];
+	output = argv[2 + quantized];
+	if (initLookupTable(&table, input) != 0) {
+		fprintf(stderr, "Could not read %s\n", input);
+		return EXIT_FAILURE;
+	}
+	length = strlen(output);
+	if (quantized) {
+		status = quantizeTable(&quant, &table);
+		if (status == 0)
+			status = writeQuantSource(&quant, output, input);
+		freeQuantTable(&quant);
+	}
+	else if (length > 2 && strcmp(output + length - 2, ".h") == 0) {
+		status = writeTableSource(&table, output, input);
+	}
+	else {
+		status = writeTableFile(&table, output);
+	}
+	if (status != 0) {
+		fprintf(stderr, "Could not write %s\n", output);
+		freeLookupTable(&table);
+		return EXIT_FAILURE;
+	}
+	printf("Compiled %zu rows (%d x %d grid) into %s\n", table.count, table.servoCount, table.platCount, output);
+	freeLookupTable(&table);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,322 @@
+#include "calculations.h"
+#include "photomodel.h"
+#include "parse_csv.h"
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define MAXBYTES 256
+// Readings above this are zeroed before fitting, as limitV does in PlotVoltageFit.m
+#define LIMITV 100
+// Angles are divided by this while accumulating to keep the normal equations well conditioned
+#define FITSCALE 30.0
+
+// Normal equations for all four channels over part of the data. The design matrix is the
+// same for every channel, so only the right hand sides differ.
+typedef struct fit_sums_s {
+	double ata[POLYTERMS][POLYTERMS];
+	double atb[4][POLYTERMS];
+	double xMin;
+	double xMax;
+	double yMin;
+	double yMax;
+	size_t samples;
+	size_t clipped;
+} fit_sums_t;
+
+// One input file and the sums collected from it
+typedef struct fit_job_s {
+	const char *filename;
+	double limit;
+	int normalize;
+	int status;
+	fit_sums_t sums;
+} fit_job_t;
+
+// The file list shared by the worker threads, each taking the next file not yet read
+typedef struct fit_pool_s {
+	fit_job_t *jobs;
+	int files;
+	int next;
+	pthread_mutex_t lock;
+} fit_pool_t;
+
+static void *runWorker(void *arg);
+static void accumulateFile(fit_job_t *job);
+static void addSums(fit_sums_t *total, const fit_sums_t *part);
+static int solveNormal(double ata[POLYTERMS][POLYTERMS], double atb[4][POLYTERMS], double coef[4][POLYTERMS]);
+
+/*
+Fits poly23 surfaces for all four photodiode channels from any number of campaign files,
+read by a pool of at most one thread per online core, and writes coefficients for
+loadPhotoModel.
+Lines are servo,plat,v1,v2,v3,v4 as the sweep sends them. Headers and blank lines are skipped.
+usage: fit_poly [-n] [-l limit] [-o output] <campaign> [campaign...]
+  -n  fit normalized ratios (v_i / sum) instead of raw voltages
+  -l  zero readings above limit, default LIMITV
+  -o  write to this file instead of stdout
+*/
+int main(int argc, char *argv[]) {
+	fit_job_t *jobs;
+	fit_pool_t pool;
+	pthread_t *ids;
+	fit_sums_t total;
+	photomodel_t model;
+	const char *output = NULL;
+	char comment[MAXBYTES];
+	double limit = LIMITV;
+	int normalize = 0;
+	int files;
+	int threads;
+	int started;
+	int option;
+	int i;
+	int j;
+	int k;
+
+	while ((option = getopt(argc, argv, "nl:o:")) != -1) {
+		if (option == 'n')
+			normalize = 1;
+		else if (option == 'l')
+			limit = atof(optarg);
+		else if (option == 'o')
+			output = optarg;
+		else
+			optind = argc + 1;
+	}
+	files = argc - optind;
+	if (files < 1) {
+		fprintf(stderr, "usage: %s [-n] [-l limit] [-o output] <campaign> [campaign...]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads > files)
+		threads = files;
+	if (threads < 1)
+		threads = 1;
+	jobs = calloc(files, sizeof(fit_job_t));
+	ids = malloc(threads * sizeof(pthread_t));
+	if (jobs == NULL || ids == NULL) {
+		free(jobs);
+		free(ids);
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < files; i++) {
+		jobs[i].filename = argv[optind + i];
+		jobs[i].limit = limit;
+		jobs[i].normalize = normalize;
+	}
+	pool.jobs = jobs;
+	pool.files = files;
+	pool.next = 0;
+	pthread_mutex_init(&pool.lock, NULL);
+	for (started = 0; started < threads; started++) {
+		if (pthread_create(&ids[started], NULL, runWorker, &pool) != 0)
+			break;
+	}
+	// This thread works through the list too, so it is read even if no thread started
+	runWorker(&pool);
+	for (i = 0; i < started; i++)
+		pthread_join(ids[i], NULL);
+	pthread_mutex_destroy(&pool.lock);
+	free(ids);
+
+	memset(&total, 0, sizeof(total));
+	for (i = 0; i < files; i++) {
+		if (jobs[i].status != 0) {
+			fprintf(stderr, "Could not read %s\n", jobs[i].filename);
+			free(jobs);
+			return EXIT_FAILURE;
+		}
+		addSums(&total, &jobs[i].sums);
+	}
+	free(jobs);
+	if (total.samples < POLYTERMS || solveNormal(total.ata, total.atb, model.coef) != 0) {
+		fprintf(stderr, "Not enough distinct angles to fit\n");
+		return EXIT_FAILURE;
+	}
+
+	// The fit was done on scaled angles, so p_ij picks up a factor of FITSCALE^-(i+j)
+	for (k = 0; k < 4; k++) {
+		for (j = 0; j < POLYTERMS; j++) {
+			static const int degree[POLYTERMS] = { 0, 1, 1, 2, 2, 2, 3, 3, 3 };
+			model.coef[k][j] /= pow(FITSCALE, degree[j]);
+		}
+	}
+	model.xMin = total.xMin;
+	model.xMax = total.xMax;
+	model.yMin = total.yMin;
+	model.yMax = total.yMax;
+	snprintf(comment, sizeof(comment), "poly23 fit of %s%s %s over %zu samples (%zu readings zeroed above %g)",
+		argv[optind], files > 1 ? " and others," : "", normalize ? "ratios" : "voltages", total.samples, total.clipped, limit);
+	if (writePhotoModel(&model, output, comment) != 0) {
+		fprintf(stderr, "Could not write %s\n", output);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/*
+Reads files from the pool until none are left
+@param arg - the fit_pool_t to take files from
+@return - NULL
+*/
+static void *runWorker(void *arg) {
+	fit_pool_t *pool = arg;
+	int file;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		file = pool->next < pool->files ? pool->next++ : -1;
+		pthread_mutex_unlock(&pool->lock);
+		if (file < 0)
+			return NULL;
+		accumulateFile(&pool->jobs[file]);
+	}
+}
+
+/*
+Reads one campaign file and accumulates its normal equations
+@param job - the file to read, status is set to -1 if it can't be read
+*/
+static void accumulateFile(fit_job_t *job) {
+	fit_sums_t *sums = &job->sums;
+	sweep_reader_t reader;
+	sweep_row_t row;
+	double terms[POLYTERMS];
+	double volts[4];
+	double sum;
+	int servo;
+	int plat;
+	int status;
+	FILE *fp;
+	int i;
+	int j;
+
+	memset(sums, 0, sizeof(fit_sums_t));
+	job->status = -1;
+	fp = fopen(job->filename, "r");
+	if (fp == NULL)
+		return;
+	if (openSweepReader(&reader, fp) != 0) {
+		fclose(fp);
+		return;
+	}
+	while ((status = nextSweepRow(&reader, &row)) != CSV_END) {
+		if (status == CSV_MALFORMED)
+			continue;
+		servo = row.servo;
+		plat = row.plat;
+		volts[0] = row.volts.volt1;
+		volts[1] = row.volts.volt2;
+		volts[2] = row.volts.volt3;
+		volts[3] = row.volts.volt4;
+		for (i = 0; i < 4; i++) {
+			if (volts[i] > job->limit) {
+				volts[i] = 0;
+				sums->clipped++;
+			}
+		}
+		if (job->normalize) {
+			sum = volts[0] + volts[1] + volts[2] + volts[3];
+			if (sum <= 0)
+				continue;
+			for (i = 0; i < 4; i++)
+				volts[i] /= sum;
+		}
+		if (sums->samples == 0 || servo < sums->xMin)
+			sums->xMin = servo;
+		if (sums->samples == 0 || servo > sums->xMax)
+			sums->xMax = servo;
+		if (sums->samples == 0 || plat < sums->yMin)
+			sums->yMin = plat;
+		if (sums->samples == 0 || plat > sums->yMax)
+			sums->yMax = plat;
+		getPolyTerms(servo / FITSCALE, plat / FITSCALE, terms);
+		for (i = 0; i < POLYTERMS; i++) {
+			for (j = 0; j < POLYTERMS; j++)
+				sums->ata[i][j] += terms[i] * terms[j];
+			for (j = 0; j < 4; j++)
+				sums->atb[j][i] += terms[i] * volts[j];
+		}
+		sums->samples++;
+	}
+	closeSweepReader(&reader);
+	if (!ferror(fp))
+		job->status = 0;
+	fclose(fp);
+}
+
+/*
+Adds the sums from one part of the data into the total
+*/
+static void addSums(fit_sums_t *total, const fit_sums_t *part) {
+	int i;
+	int j;
+
+	if (part->samples == 0)
+		return;
+	for (i = 0; i < POLYTERMS; i++) {
+		for (j = 0; j < POLYTERMS; j++)
+			total->ata[i][j] += part->ata[i][j];
+		for (j = 0; j < 4; j++)
+			total->atb[j][i] += part->atb[j][i];
+	}
+	if (total->samples == 0 || part->xMin < total->xMin)
+		total->xMin = part->xMin;
+	if (total->samples == 0 || part->xMax > total->xMax)
+		total->xMax = part->xMax;
+	if (total->samples == 0 || part->yMin < total->yMin)
+		total->yMin = part->yMin;
+	if (total->samples == 0 || part->yMax > total->yMax)
+		total->yMax = part->yMax;
+	total->samples += part->samples;
+	total->clipped += part->clipped;
+}
+
+/*
+Solves the normal equations for all four channels with one Cholesky factorization
+@param ata - the shared left hand side, overwritten by its factor
+@param atb - the right hand side of each channel
+@param coef - receives the coefficients of each channel
+@return - 0 on success, -1 if the system is singular
+*/
+static int solveNormal(double ata[POLYTERMS][POLYTERMS], double atb[4][POLYTERMS], double coef[4][POLYTERMS]) {
+	double sum;
+	int i;
+	int j;
+	int k;
+	int c;
+
+	for (j = 0; j < POLYTERMS; j++) {
+		sum = ata[j][j];
+		for (k = 0; k < j; k++)
+			sum -= ata[j][k] * ata[j][k];
+		if (sum <= 0)
+			return -1;
+		ata[j][j] = sqrt(sum);
+		for (i = j + 1; i < POLYTERMS; i++) {
+			sum = ata[i][j];
+			for (k = 0; k < j; k++)
+				sum -= ata[i][k] * ata[j][k];
+			ata[i][j] = sum / ata[j][j];
+		}
+	}
+	for (c = 0; c < 4; c++) {
+		// Forward substitution with L, then back substitution with L transposed
+		for (i = 0; i < POLYTERMS; i++) {
+			sum = atb[c][i];
+			for (k = 0; k < i; k++)
+				sum -= ata[i][k] * coef[c][k];
+			coef[c][i] = sum / ata[i][i];
+		}
+		for (i = POLYTERMS - 1; i >= 0; i--) {
+			sum = coef[c][i];
+			for (k = i + 1; k < POLYTERMS; k++)
+				sum -= ata[k][i] * coef[c][k];
+			coef[c][i] = sum / ata[i][i];
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,65 @@
+#include "interpolate.h"
+
+/*
+Calculates sub-degree angles by finding the best match and interpolating around it
+@param table - the lookup table
+@param realVolts - the voltage readings
+@param angle - receives the interpolated angles, unchanged if nothing matched
+@return - the deviation of the best match, MAXVOLTDIFF if nothing matched or the reading is dark
+or not finite
+*/
+float getAnglesInterp(const lookup_table_t *table, const voltage_t *realVolts, anglef_t *angle) {
+	voltage_t norm;
+	float best;
+	size_t row;
+
+	if (isBadReading(realVolts) || isDark(table, realVolts))
+		return MAXVOLTDIFF;
+	normalizeVoltage(realVolts, &norm);
+	row = findBestMatch(table, &norm, &best);
+	if (row >= table->count)
+		return MAXVOLTDIFF;
+	interpolateAngles(table, &norm, row, angle);
+	return best;
+}
+
+/*
+Blends the angles of the grid cells around a match, weighting each by its inverse squared
+deviation from the reading, so a reading between cells lands between their angles
+@param table - the lookup table
+@param norm - the normalized voltage reading
+@param bestRow - the row that matched best
+@param angle - receives the interpolated angles
+@return - the sum of the weights, larger when the neighbourhood matches more closely
+*/
+float interpolateAngles(const lookup_table_t *table, const voltage_t *norm, size_t bestRow, anglef_t *angle) {
+	float weight;
+	float total = 0;
+	float alpha = 0;
+	float beta = 0;
+	float current;
+	int servo;
+	int plat;
+	int row;
+
+	for (plat = table->plat[bestRow] - INTERPRADIUS; plat <= table->plat[bestRow] + INTERPRADIUS; plat++) {
+		for (servo = table->servo[bestRow] - INTERPRADIUS; servo <= table->servo[bestRow] + INTERPRADIUS; servo++) {
+			row = getGridRow(table, servo, plat);
+			if (row < 0)
+				continue;
+			current =
+				fabsf(table->volt1[row] - norm->volt1) +
+				fabsf(table->volt2[row] - norm->volt2) +
+				fabsf(table->volt3[row] - norm->volt3) +
+				fabsf(table->volt4[row] - norm->volt4) + INTERPEPSILON;
+			weight = 1 / (current * current);
+			total += weight;
+			alpha += weight * servo;
+			beta += weight * plat;
+		}
+	}
+	// The best row itself is always in the neighbourhood, so total is never zero
+	angle->alpha = alpha / total;
+	angle->beta = beta / total;
+	return total;
+}
@@ -0,0 +1,15 @@
+#ifndef INTERPOLATE_H
+#define INTERPOLATE_H
+
+#include "calculations.h"
+
+// Half width of the grid neighbourhood blended around the best match
+#define INTERPRADIUS 2
+// Added to each deviation before weighting so an exact match doesn't divide by zero
+#define INTERPEPSILON 0.01f
+
+float getAnglesInterp(const lookup_table_t *table, const voltage_t *realVolts, anglef_t *angle);
+
+float interpolateAngles(const lookup_table_t *table, const voltage_t *norm, size_t bestRow, anglef_t *angle);
+
+#endif
@@ -0,0 +1,321 @@
+#include "kdtree.h"
+#include <string.h>
+// Ranges at most this long are scanned directly instead of split further
+#define LEAFSIZE 8
+// Margin on the pruning bound so rounding can never prune a row that ties the best
+#define KDSLACK 1e-4f
+
+// State carried down one nearest neighbour search. A search for the second match as well
+// keeps its candidates in kept, and best is then their bound.
+typedef struct kdsearch_s {
+	const kdtree_t *tree;
+	float query[4];
+	float offset[4];
+	float best;
+	size_t bestRow;
+	float goodEnough;
+	const lookup_table_t *table;
+	match_rows_t *kept;
+} kdsearch_t;
+
+static void buildRange(kdtree_t *tree, size_t lo, size_t hi);
+static void selectMedian(kdtree_t *tree, size_t lo, size_t hi, size_t k, int axis);
+static void swapNodes(kdtree_t *tree, size_t a, size_t b);
+static void searchRange(kdsearch_t *search, size_t lo, size_t hi, float bound);
+static void checkNode(kdsearch_t *search, size_t node);
+
+/*
+Builds a k-d tree over the normalized rows of a table
+@param table - the table with its columns filled in
+@return - the tree, or NULL if out of memory
+*/
+kdtree_t *buildKdTree(const lookup_table_t *table) {
+	kdtree_t *tree = malloc(sizeof(kdtree_t));
+	size_t i;
+
+	if (tree == NULL)
+		return NULL;
+	// Never ask for zero bytes so an empty table still gets a valid tree
+	tree->block = aligned_alloc(TABLEALIGN, getKdTreeSize(table->count) + TABLEALIGN);
+	if (tree->block == NULL) {
+		free(tree);
+		return NULL;
+	}
+	setKdTreeArrays(tree, tree->block, table->count);
+	for (i = 0; i < table->count; i++) {
+		tree->points[i][0] = table->volt1[i];
+		tree->points[i][1] = table->volt2[i];
+		tree->points[i][2] = table->volt3[i];
+		tree->points[i][3] = table->volt4[i];
+		tree->rows[i] = i;
+	}
+	memset(tree->axis, 0, tree->count);
+	buildRange(tree, 0, tree->count);
+	return tree;
+}
+
+/*
+Wraps a tree that was already built and saved, such as one mapped from a compiled table file
+@param base - the start of the saved tree arrays, aligned to TABLEALIGN
+@param count - the number of rows in the tree
+@return - the tree, or NULL if out of memory
+*/
+kdtree_t *viewKdTree(void *base, size_t count) {
+	kdtree_t *tree = malloc(sizeof(kdtree_t));
+
+	if (tree == NULL)
+		return NULL;
+	tree->block = NULL;
+	setKdTreeArrays(tree, base, count);
+	return tree;
+}
+
+/*
+Gives the bytes needed for the arrays of a tree, each padded to TABLEALIGN
+@param count - the number of rows in the tree
+@return - the size of the tree arrays
+*/
+size_t getKdTreeSize(size_t count) {
+	size_t rowBytes = (count * sizeof(unsigned int) + TABLEALIGN - 1) / TABLEALIGN * TABLEALIGN;
+	size_t axisBytes = (count + TABLEALIGN - 1) / TABLEALIGN * TABLEALIGN;
+	return count * sizeof(float[4]) + rowBytes + axisBytes;
+}
+
+/*
+Points the tree arrays into one block laid out as points, rows, axis
+@param tree - the tree
+@param base - the start of the block, aligned to TABLEALIGN
+@param count - the number of rows in the tree
+*/
+void setKdTreeArrays(kdtree_t *tree, void *base, size_t count) {
+	char *array = base;
+	tree->count = count;
+	tree->points = (float (*)[4])array;
+	array += count * sizeof(float[4]);
+	tree->rows = (unsigned int *)array;
+	array += (count * sizeof(unsigned int) + TABLEALIGN - 1) / TABLEALIGN * TABLEALIGN;
+	tree->axis = (unsigned char *)array;
+}
+
+/*
+Releases a tree made by buildKdTree or viewKdTree
+@param tree - the tree, may be NULL
+*/
+void freeKdTree(kdtree_t *tree) {
+	if (tree == NULL)
+		return;
+	free(tree->block);
+	free(tree);
+}
+
+/*
+Finds the table row nearest to a reading, giving exactly the row a full scan would
+@param tree - the tree built over the table
+@param norm - the normalized voltage reading
+@param bestDev - receives the lowest deviation found
+@return - the index of the best row, or the table row count if no row is under MAXVOLTDIFF
+*/
+size_t kdFindBestRow(const kdtree_t *tree, const voltage_t *norm, float *bestDev) {
+	return kdFindGoodRow(tree, norm, 0, bestDev);
+}
+
+/*
+Finds a table row near a reading, stopping as soon as one is under goodEnough
+@param tree - the tree built over the table
+@param norm - the normalized voltage reading
+@param goodEnough - deviation low enough to stop at, 0 to find the best row
+@param bestDev - receives the deviation of the row returned
+@return - the index of the row, or the table row count if no row is under MAXVOLTDIFF
+*/
+size_t kdFindGoodRow(const kdtree_t *tree, const voltage_t *norm, float goodEnough, float *bestDev) {
+	kdsearch_t search;
+
+	search.tree = tree;
+	search.query[0] = norm->volt1;
+	search.query[1] = norm->volt2;
+	search.query[2] = norm->volt3;
+	search.query[3] = norm->volt4;
+	search.offset[0] = search.offset[1] = search.offset[2] = search.offset[3] = 0;
+	search.best = MAXVOLTDIFF;
+	search.bestRow = tree->count;
+	search.goodEnough = goodEnough;
+	search.kept = NULL;
+	searchRange(&search, 0, tree->count, 0);
+	*bestDev = search.best;
+	return search.bestRow;
+}
+
+/*
+Finds the candidates of the best and second match in one search, pruning with their bound
+@param tree - the tree built over the table
+@param table - the table the tree was built over
+@param norm - the normalized voltage reading
+@param kept - receives the candidates
+*/
+void kdFindMatchRows(const kdtree_t *tree, const lookup_table_t *table, const voltage_t *norm, match_rows_t *kept) {
+	kdsearch_t search;
+
+	kept->found = 0;
+	kept->bound = MAXVOLTDIFF;
+	search.tree = tree;
+	search.query[0] = norm->volt1;
+	search.query[1] = norm->volt2;
+	search.query[2] = norm->volt3;
+	search.query[3] = norm->volt4;
+	search.offset[0] = search.offset[1] = search.offset[2] = search.offset[3] = 0;
+	search.best = MAXVOLTDIFF;
+	search.bestRow = tree->count;
+	search.goodEnough = 0;
+	search.table = table;
+	search.kept = kept;
+	searchRange(&search, 0, tree->count, 0);
+}
+
+/*
+Splits a range on its widest axis at the median and recurses into both halves
+@param tree - the tree being built
+@param lo - first node of the range
+@param hi - one past the last node of the range
+*/
+static void buildRange(kdtree_t *tree, size_t lo, size_t hi) {
+	size_t mid = lo + (hi - lo) / 2;
+	float low[4];
+	float high[4];
+	int axis = 0;
+	int a;
+	size_t i;
+
+	if (hi - lo <= LEAFSIZE)
+		return;
+	for (a = 0; a < 4; a++)
+		low[a] = high[a] = tree->points[lo][a];
+	for (i = lo + 1; i < hi; i++) {
+		for (a = 0; a < 4; a++) {
+			if (tree->points[i][a] < low[a])
+				low[a] = tree->points[i][a];
+			if (tree->points[i][a] > high[a])
+				high[a] = tree->points[i][a];
+		}
+	}
+	for (a = 1; a < 4; a++) {
+		if (high[a] - low[a] > high[axis] - low[axis])
+			axis = a;
+	}
+	selectMedian(tree, lo, hi, mid, axis);
+	tree->axis[mid] = axis;
+	buildRange(tree, lo, mid);
+	buildRange(tree, mid + 1, hi);
+}
+
+/*
+Reorders a range so node k holds its median on one axis, smaller before and larger after
+@param tree - the tree being built
+@param lo - first node of the range
+@param hi - one past the last node of the range
+@param k - the node that should end up holding the median
+@param axis - the coordinate to order by
+*/
+static void selectMedian(kdtree_t *tree, size_t lo, size_t hi, size_t k, int axis) {
+	size_t store;
+	size_t i;
+	float pivot;
+
+	while (hi - lo > 1) {
+		swapNodes(tree, lo + (hi - lo) / 2, hi - 1);
+		pivot = tree->points[hi - 1][axis];
+		store = lo;
+		for (i = lo; i < hi - 1; i++) {
+			if (tree->points[i][axis] < pivot)
+				swapNodes(tree, i, store++);
+		}
+		swapNodes(tree, store, hi - 1);
+		if (store == k)
+			return;
+		if (k < store)
+			hi = store;
+		else
+			lo = store + 1;
+	}
+}
+
+/*
+Swaps two nodes of the tree along with the table rows they refer to
+*/
+static void swapNodes(kdtree_t *tree, size_t a, size_t b) {
+	float point[4];
+	unsigned int row;
+
+	memcpy(point, tree->points[a], sizeof(point));
+	memcpy(tree->points[a], tree->points[b], sizeof(point));
+	memcpy(tree->points[b], point, sizeof(point));
+	row = tree->rows[a];
+	tree->rows[a] = tree->rows[b];
+	tree->rows[b] = row;
+}
+
+/*
+Searches one range of the tree, skipping halves that cannot beat the best row so far
+@param search - the search state
+@param lo - first node of the range
+@param hi - one past the last node of the range
+@param bound - lower bound on the deviation of any row in the range
+*/
+static void searchRange(kdsearch_t *search, size_t lo, size_t hi, float bound) {
+	size_t mid = lo + (hi - lo) / 2;
+	size_t i;
+	int axis;
+	float diff;
+	float saved;
+	float farBound;
+
+	if (bound - KDSLACK > search->best || search->best < search->goodEnough)
+		return;
+	if (hi - lo <= LEAFSIZE) {
+		for (i = lo; i < hi; i++)
+			checkNode(search, i);
+		return;
+	}
+	checkNode(search, mid);
+	axis = search->tree->axis[mid];
+	diff = search->query[axis] - search->tree->points[mid][axis];
+	saved = search->offset[axis];
+	// The far half is at least |diff| away on this axis instead of the old offset
+	farBound = bound - saved + fabsf(diff);
+	if (diff < 0) {
+		searchRange(search, lo, mid, bound);
+		search->offset[axis] = fabsf(diff);
+		searchRange(search, mid + 1, hi, farBound);
+	}
+	else {
+		searchRange(search, mid + 1, hi, bound);
+		search->offset[axis] = fabsf(diff);
+		searchRange(search, lo, mid, farBound);
+	}
+	search->offset[axis] = saved;
+}
+
+/*
+Compares one node against the best row, keeping the lowest row number on a tie like a full scan.
+A search for the second match as well adds it to the candidates instead.
+@param search - the search state
+@param node - the node to check
+*/
+static void checkNode(kdsearch_t *search, size_t node) {
+	const float *point = search->tree->points[node];
+	size_t row = search->tree->rows[node];
+	float current =
+		fabsf(point[0] - search->query[0]) +
+		fabsf(point[1] - search->query[1]) +
+		fabsf(point[2] - search->query[2]) +
+		fabsf(point[3] - search->query[3]);
+
+	if (search->kept != NULL) {
+		keepMatchRow(search->table, search->kept, row, current);
+		search->best = search->kept->bound;
+		return;
+	}
+	if (current < search->best || (current == search->best && row < search->bestRow)) {
+		search->best = current;
+		search->bestRow = row;
+	}
+}
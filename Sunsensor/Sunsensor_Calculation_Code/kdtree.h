@@ -0,0 +1,33 @@
+#ifndef KDTREE_H
+#define KDTREE_H
+
+#include "calculations.h"
+
+// Balanced k-d tree over the normalized table rows, stored implicitly: the node for
+// the range [lo, hi) sits at (lo + hi) / 2 with its children in the two halves. The
+// arrays share one block, which is NULL when they live in a mapped table file.
+typedef struct kdtree_s {
+	float (*points)[4];
+	unsigned int *rows;
+	unsigned char *axis;
+	size_t count;
+	void *block;
+} kdtree_t;
+
+kdtree_t *buildKdTree(const lookup_table_t *table);
+
+kdtree_t *viewKdTree(void *base, size_t count);
+
+size_t getKdTreeSize(size_t count);
+
+void setKdTreeArrays(kdtree_t *tree, void *base, size_t count);
+
+void freeKdTree(kdtree_t *tree);
+
+size_t kdFindBestRow(const kdtree_t *tree, const voltage_t *norm, float *bestDev);
+
+size_t kdFindGoodRow(const kdtree_t *tree, const voltage_t *norm, float goodEnough, float *bestDev);
+
+void kdFindMatchRows(const kdtree_t *tree, const lookup_table_t *table, const voltage_t *norm, match_rows_t *kept);
+
+#endif
@@ -0,0 +1,423 @@
+#define _GNU_SOURCE
+#include "parse_csv.h"
+#include <stdint.h>
+#include <string.h>
+#include <locale.h>
+#include <pthread.h>
+#include <unistd.h>
+// The shortest line that can hold a row, "0,0,0,0,0,0\n"
+#define MINROWBYTES 12
+// Longest run of digits that fits in the 2^53 a double holds exactly
+#define MAXDIGITS 15
+// Longest number parseFloatSlow looks at
+#define MAXNUMBER 63
+
+// The slice of a file parsed by one thread
+typedef struct csv_part_s {
+	const char *start;
+	const char *end;
+	sweep_row_t *rows;
+	size_t count;
+} csv_part_t;
+
+// Powers of ten a double holds exactly, so one multiply or divide rounds correctly
+static const double powersOfTen[MAXDIGITS + 1] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+// The "C" locale parseFloatSlow reads numbers in, made once by whichever thread needs it first
+static locale_t numberLocale;
+static pthread_once_t numberLocaleOnce = PTHREAD_ONCE_INIT;
+
+static const char *skipSpaces(const char *p);
+static int parseInt(const char **cursor, int *value);
+static int parseFloat(const char **cursor, float *value);
+static int parseFloatSlow(const char *number, const char **cursor, float *value);
+static void initNumberLocale(void);
+static int parseComma(const char **cursor);
+static void *runCsvPart(void *arg);
+
+/*
+Parses the next servo,plat,v1,v2,v3,v4 line, skipping blank lines before it. A trailing
+comma, spaces and a carriage return are allowed. Numbers are read with plain digit loops,
+and the few that need strtof are read in the "C" locale, so the result does not depend on
+LC_NUMERIC. Only the blank lines and the end of a
+malformed line are bounded by end: the text must finish with a newline or be followed by a
+NUL, as it is in parseSweepFile and the stream reader, so the digit loops need no checks.
+@param cursor - where to start, moved past the line that was read
+@param end - the end of the text
+@param row - receives the row, unchanged unless CSV_ROW is returned
+@return - CSV_ROW, CSV_END if only blank lines were left, or CSV_MALFORMED if the line
+was skipped because it is not a row (a header, say)
+*/
+int parseSweepRow(const char **cursor, const char *end, sweep_row_t *row) {
+	const char *p = *cursor;
+	sweep_row_t parsed;
+	int ok;
+
+	while (p < end && (*p == '\n' || *p == '\r' || *p == ' ' || *p == '\t'))
+		p++;
+	if (p == end) {
+		*cursor = p;
+		return CSV_END;
+	}
+	ok = parseInt(&p, &parsed.servo) && parseComma(&p) &&
+		parseInt(&p, &parsed.plat) && parseComma(&p) &&
+		parseFloat(&p, &parsed.volts.volt1) && parseComma(&p) &&
+		parseFloat(&p, &parsed.volts.volt2) && parseComma(&p) &&
+		parseFloat(&p, &parsed.volts.volt3) && parseComma(&p) &&
+		parseFloat(&p, &parsed.volts.volt4);
+	if (ok) {
+		p = skipSpaces(p);
+		if (*p == ',')
+			p = skipSpaces(p + 1);
+		if (*p == '\r')
+			p++;
+		ok = p >= end || *p == '\n';
+	}
+	while (p < end && *p != '\n')
+		p++;
+	*cursor = p < end ? p + 1 : p;
+	if (!ok)
+		return CSV_MALFORMED;
+	*row = parsed;
+	return CSV_ROW;
+}
+
+/*
+Reads a whole lookup table or sweep log into memory and parses it, splitting large files
+into chunks that are parsed on separate threads. Lines that are not rows are skipped.
+@param filename - path of the file
+@param rows - receives the rows in file order, to be released with free
+@param count - receives the number of rows
+@param threads - the threads to use, 0 for one per online core when the file is large
+@return - 0 on success, -1 if the file could not be read or memory ran out
+*/
+int parseSweepFile(const char *filename, sweep_row_t **rows, size_t *count, int threads) {
+	pthread_t ids[CSVTHREADS];
+	csv_part_t parts[CSVTHREADS];
+	FILE *fp;
+	char *text;
+	const char *start;
+	const char *split;
+	long length;
+	size_t total = 0;
+	int started = 0;
+	int status = 0;
+	int i;
+
+	*rows = NULL;
+	*count = 0;
+	fp = fopen(filename, "rb");
+	if (fp == NULL)
+		return -1;
+	if (fseek(fp, 0, SEEK_END) != 0 || (length = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+		fclose(fp);
+		return -1;
+	}
+	text = malloc(length + 1);
+	if (text == NULL || fread(text, 1, length, fp) != (size_t)length) {
+		free(text);
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	text[length] = '\0';
+
+	// Left to choose, use no more threads than there are CSVCHUNK sized chunks
+	if (threads <= 0) {
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (threads > length / CSVCHUNK)
+			threads = length / CSVCHUNK;
+	}
+	if (threads > CSVTHREADS)
+		threads = CSVTHREADS;
+	if (threads < 1)
+		threads = 1;
+
+	// Cut the text into roughly equal chunks, moving each cut to just after a newline
+	start = text;
+	for (i = 0; i < threads; i++) {
+		split = i == threads - 1 ? text + length : text + (size_t)length / threads * (i + 1);
+		if (split < start)
+			split = start;
+		while (split > text && split < text + length && split[-1] != '\n')
+			split++;
+		parts[i].start = start;
+		parts[i].end = split;
+		parts[i].rows = NULL;
+		parts[i].count = 0;
+		start = split;
+	}
+	if (threads == 1) {
+		runCsvPart(&parts[0]);
+	}
+	else {
+		for (started = 0; started < threads; started++) {
+			if (pthread_create(&ids[started], NULL, runCsvPart, &parts[started]) != 0) {
+				status = -1;
+				break;
+			}
+		}
+		for (i = 0; i < started; i++)
+			pthread_join(ids[i], NULL);
+	}
+	free(text);
+	for (i = 0; i < threads && status == 0; i++) {
+		if (parts[i].rows == NULL)
+			status = -1;
+		total += parts[i].count;
+	}
+
+	// The first chunk's array is grown to hold the rest, so one thread needs no copy
+	if (status == 0 && threads > 1) {
+		*rows = realloc(parts[0].rows, (total + 1) * sizeof(sweep_row_t));
+		if (*rows == NULL) {
+			status = -1;
+		}
+		else {
+			parts[0].rows = NULL;
+			total = parts[0].count;
+			for (i = 1; i < threads; i++) {
+				memcpy(*rows + total, parts[i].rows, parts[i].count * sizeof(sweep_row_t));
+				total += parts[i].count;
+			}
+		}
+	}
+	else if (status == 0) {
+		*rows = parts[0].rows;
+		parts[0].rows = NULL;
+	}
+	for (i = 0; i < threads; i++)
+		free(parts[i].rows);
+	if (status != 0)
+		return -1;
+	*count = total;
+	return 0;
+}
+
+/*
+Parses one chunk of a file into its own array
+@param arg - the csv_part_t to work on, rows is left NULL if memory ran out
+@return - NULL
+*/
+static void *runCsvPart(void *arg) {
+	csv_part_t *part = arg;
+	const char *cursor = part->start;
+	sweep_row_t row;
+	int status;
+
+	part->rows = malloc(((part->end - part->start) / MINROWBYTES + 1) * sizeof(sweep_row_t));
+	if (part->rows == NULL)
+		return NULL;
+	while ((status = parseSweepRow(&cursor, part->end, &row)) != CSV_END) {
+		if (status == CSV_ROW)
+			part->rows[part->count++] = row;
+	}
+	return NULL;
+}
+
+/*
+Starts reading rows from a stream through a fixed buffer, so memory does not grow with the
+length of the stream
+@param reader - the reader to set up, released with closeSweepReader
+@param fp - the open stream, left open by closeSweepReader
+@return - 0 on success, -1 if out of memory
+*/
+int openSweepReader(sweep_reader_t *reader, FILE *fp) {
+	reader->fp = fp;
+	reader->start = 0;
+	reader->end = 0;
+	reader->eof = 0;
+	reader->buffer = malloc(CSVBUFFER + 1);
+	return reader->buffer != NULL ? 0 : -1;
+}
+
+/*
+Reads the next row from a stream. The buffer keeps a NUL after the data so parseSweepRow
+can read the last line. A line longer than CSVBUFFER is given back as malformed.
+@param reader - a reader set up with openSweepReader
+@param row - receives the row
+@return - CSV_ROW, CSV_MALFORMED for a line that was skipped, or CSV_END at the end of the
+stream or on a read error (check ferror on the stream)
+*/
+int nextSweepRow(sweep_reader_t *reader, sweep_row_t *row) {
+	const char *line;
+	const char *lineEnd;
+	const char *newline;
+	size_t got;
+	int status;
+
+	for (;;) {
+		line = reader->buffer + reader->start;
+		newline = memchr(line, '\n', reader->end - reader->start);
+		if (newline == NULL && !reader->eof) {
+			if (reader->start == 0 && reader->end == CSVBUFFER) {
+				// No room left for the rest of the line, drop what there is of it
+				reader->start = reader->end = 0;
+				do {
+					got = fread(reader->buffer, 1, CSVBUFFER, reader->fp);
+					newline = memchr(reader->buffer, '\n', got);
+				} while (newline == NULL && got == CSVBUFFER);
+				reader->start = newline != NULL ? newline + 1 - reader->buffer : got;
+				reader->end = got;
+				reader->buffer[reader->end] = '\0';
+				reader->eof = got < CSVBUFFER && newline == NULL;
+				return CSV_MALFORMED;
+			}
+			memmove(reader->buffer, line, reader->end - reader->start);
+			reader->end -= reader->start;
+			reader->start = 0;
+			got = fread(reader->buffer + reader->end, 1, CSVBUFFER - reader->end, reader->fp);
+			reader->end += got;
+			reader->buffer[reader->end] = '\0';
+			if (got == 0)
+				reader->eof = 1;
+			continue;
+		}
+		if (reader->start == reader->end)
+			return CSV_END;
+		lineEnd = newline != NULL ? newline + 1 : reader->buffer + reader->end;
+		status = parseSweepRow(&line, lineEnd, row);
+		reader->start = line - reader->buffer;
+		if (status != CSV_END)
+			return status;
+	}
+}
+
+/*
+Releases the buffer of a reader
+@param reader - a reader set up with openSweepReader
+*/
+void closeSweepReader(sweep_reader_t *reader) {
+	free(reader->buffer);
+	reader->buffer = NULL;
+}
+
+/*
+Skips spaces and tabs
+*/
+static const char *skipSpaces(const char *p) {
+	while (*p == ' ' || *p == '\t')
+		p++;
+	return p;
+}
+
+/*
+Reads a comma between two fields, with any spaces around it
+*/
+static int parseComma(const char **cursor) {
+	const char *p = skipSpaces(*cursor);
+	if (*p != ',')
+		return 0;
+	*cursor = p + 1;
+	return 1;
+}
+
+/*
+Reads a decimal integer of at most nine digits
+@param cursor - where to start, moved past the number
+@param value - receives the number
+@return - 1 if a number was read, 0 if not
+*/
+static int parseInt(const char **cursor, int *value) {
+	const char *p = skipSpaces(*cursor);
+	const char *digits;
+	int negative = 0;
+	int number = 0;
+
+	if (*p == '-' || *p == '+')
+		negative = *p++ == '-';
+	digits = p;
+	while ((unsigned)(*p - '0') < 10 && p - digits < 9)
+		number = number * 10 + (*p++ - '0');
+	if (p == digits || (unsigned)(*p - '0') < 10)
+		return 0;
+	*value = negative ? -number : number;
+	*cursor = p;
+	return 1;
+}
+
+/*
+Reads a decimal number such as 0.83 or -12. The digits are gathered into one integer and
+scaled by one exact power of ten into a double, then rounded to a float. Rounding twice can
+only differ from strtof when the double lies within one of its own ulps of a point half way
+between two floats, so those numbers, along with numbers with an exponent or more than
+MAXDIGITS digits, are handed to parseFloatSlow. The result is always the float strtof gives.
+@param cursor - where to start, moved past the number
+@param value - receives the number
+@return - 1 if a number was read, 0 if not
+*/
+static int parseFloat(const char **cursor, float *value) {
+	const char *p = skipSpaces(*cursor);
+	const char *number = p;
+	const char *digits;
+	uint64_t mantissa = 0;
+	double scaled;
+	double half;
+	float rounded;
+	int count;
+	int fraction = 0;
+	int negative = 0;
+
+	if (*p == '-' || *p == '+')
+		negative = *p++ == '-';
+	digits = p;
+	while ((unsigned)(*p - '0') < 10)
+		mantissa = mantissa * 10 + (*p++ - '0');
+	count = p - digits;
+	if (*p == '.') {
+		digits = ++p;
+		while ((unsigned)(*p - '0') < 10)
+			mantissa = mantissa * 10 + (*p++ - '0');
+		fraction = p - digits;
+		count += fraction;
+	}
+	if (count == 0)
+		return 0;
+	if (count > MAXDIGITS || *p == 'e' || *p == 'E')
+		return parseFloatSlow(number, cursor, value);
+	scaled = (double)mantissa / powersOfTen[fraction];
+	rounded = (float)scaled;
+	if (scaled != rounded) {
+		half = ((double)rounded + nextafterf(rounded, scaled > rounded ? HUGE_VALF : 0)) / 2;
+		if (fabs(scaled - half) <= ldexp(scaled, -52))
+			return parseFloatSlow(number, cursor, value);
+	}
+	*value = negative ? -rounded : rounded;
+	*cursor = p;
+	return 1;
+}
+
+/*
+Reads a number parseFloat can't scale exactly, through strtof_l in the "C" locale on a copy
+of it, so a decimal point is read as one whatever LC_NUMERIC says
+@param number - the start of the number, after any spaces
+@param cursor - moved past the number
+@param value - receives the number
+@return - 1 if a number was read, 0 if not
+*/
+static int parseFloatSlow(const char *number, const char **cursor, float *value) {
+	char copy[MAXNUMBER + 1];
+	char *stop;
+	size_t length = 0;
+
+	while (length < MAXNUMBER && number[length] != '\0' && strchr("+-.0123456789eE", number[length]) != NULL)
+		length++;
+	memcpy(copy, number, length);
+	copy[length] = '\0';
+	pthread_once(&numberLocaleOnce, initNumberLocale);
+	// newlocale only fails out of memory, and strtof is still right under a "C" LC_NUMERIC
+	*value = numberLocale != (locale_t)0 ? strtof_l(copy, &stop, numberLocale) : strtof(copy, &stop);
+	if (stop == copy)
+		return 0;
+	*cursor = number + (stop - copy);
+	return 1;
+}
+
+/*
+Makes the "C" locale parseFloatSlow reads numbers in, kept for the life of the program
+*/
+static void initNumberLocale(void) {
+	numberLocale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+}
@@ -0,0 +1,43 @@
+#ifndef PARSE_CSV_H
+#define PARSE_CSV_H
+
+#include "calculations.h"
+
+// Results of reading one line
+#define CSV_ROW 1
+#define CSV_END 0
+#define CSV_MALFORMED -1
+// Bytes buffered by a streaming reader, also the longest line it can hold
+#define CSVBUFFER (1 << 20)
+// parseSweepFile picks at most one thread per this many bytes
+#define CSVCHUNK (4 << 20)
+// Most threads parseSweepFile will start
+#define CSVTHREADS 64
+
+// One servo,plat,v1,v2,v3,v4 line of a lookup table or sweep log, voltages as written
+typedef struct sweep_row_s {
+	int servo;
+	int plat;
+	voltage_t volts;
+} sweep_row_t;
+
+// Reads rows from a stream of any length through one fixed buffer
+typedef struct sweep_reader_s {
+	FILE *fp;
+	char *buffer;
+	size_t start;
+	size_t end;
+	int eof;
+} sweep_reader_t;
+
+int parseSweepRow(const char **cursor, const char *end, sweep_row_t *row);
+
+int parseSweepFile(const char *filename, sweep_row_t **rows, size_t *count, int threads);
+
+int openSweepReader(sweep_reader_t *reader, FILE *fp);
+
+int nextSweepRow(sweep_reader_t *reader, sweep_row_t *row);
+
+void closeSweepReader(sweep_reader_t *reader);
+
+#endif
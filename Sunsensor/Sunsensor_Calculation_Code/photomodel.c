@@ -0,0 +1,313 @@
+#include "photomodel.h"
+#include <string.h>
+#define MAXBYTES 256
+// Gauss-Newton stops once a step moves less than this many degrees
+#define GNTOLERANCE 1e-4
+// Sum of squared ratio residuals below which a start is taken without trying the others
+#define MODELTOLERANCE 1e-8
+// Sum of squared ratio residuals above which the best fit does not explain the reading. The
+// rows of the recorded tables stay under 0.01 but for a few glitches out of 3600, while
+// light on two opposite quadrants only gets down to about 0.2.
+#define MODELMAXRESIDUAL 0.1
+
+static void seedPhotoModel(photomodel_t *model);
+static double refineAngles(const photomodel_t *model, const double *real, anglef_t *angle);
+static void evalPolynomial(const double *p, double x, double y, double *value, double *dx, double *dy);
+
+/*
+Reads poly23 coefficients from a small text file. Lines starting with # are comments. The
+first value line is the fitted domain "xmin xmax ymin ymax", then one line of POLYTERMS
+coefficients per photodiode.
+@param model - the model to fill
+@param filename - path of the coefficient file
+@return - 0 on success, -1 if the file is missing or short
+*/
+int loadPhotoModel(photomodel_t *model, const char *filename) {
+	char line[MAXBYTES];
+	double values[4 + 4 * POLYTERMS];
+	int count = 0;
+	char *next;
+	char *end;
+	FILE *fp;
+	int i;
+
+	fp = fopen(filename, "r");
+	if (fp == NULL)
+		return -1;
+	while (count < 4 + 4 * POLYTERMS && fgets(line, sizeof(line), fp) != NULL) {
+		if (line[0] == '#')
+			continue;
+		next = line;
+		while (count < 4 + 4 * POLYTERMS) {
+			values[count] = strtod(next, &end);
+			if (end == next)
+				break;
+			count++;
+			next = end;
+		}
+	}
+	fclose(fp);
+	if (count < 4 + 4 * POLYTERMS)
+		return -1;
+
+	model->xMin = values[0];
+	model->xMax = values[1];
+	model->yMin = values[2];
+	model->yMax = values[3];
+	for (i = 0; i < 4 * POLYTERMS; i++)
+		model->coef[i / POLYTERMS][i % POLYTERMS] = values[4 + i];
+	seedPhotoModel(model);
+	return 0;
+}
+
+/*
+Writes coefficients out in the format loadPhotoModel reads
+@param model - the model
+@param filename - path of the file to write, or NULL for stdout
+@param comment - a line describing where the fit came from
+@return - 0 on success, -1 if the file could not be written
+*/
+int writePhotoModel(const photomodel_t *model, const char *filename, const char *comment) {
+	FILE *fp = filename != NULL ? fopen(filename, "w") : stdout;
+	int i;
+	int j;
+
+	if (fp == NULL)
+		return -1;
+	fprintf(fp, "# %s\n", comment);
+	fprintf(fp, "# x is the servo angle, y the platform angle (first and second columns of the sweep)\n");
+	fprintf(fp, "# domain: xmin xmax ymin ymax\n");
+	fprintf(fp, "%g %g %g %g\n", model->xMin, model->xMax, model->yMin, model->yMax);
+	fprintf(fp, "# one line per photodiode: p00 p10 p01 p20 p11 p02 p21 p12 p03\n");
+	for (i = 0; i < 4; i++) {
+		for (j = 0; j < POLYTERMS; j++)
+			fprintf(fp, j ? " %.9g" : "%.9g", model->coef[i][j]);
+		fprintf(fp, "\n");
+	}
+	if (filename != NULL && fclose(fp) != 0)
+		return -1;
+	return 0;
+}
+
+/*
+Calculates the POLYTERMS monomials of a poly23 surface, in coefficient order
+@param x - the servo angle
+@param y - the platform angle
+@param terms - receives 1, x, y, x^2, xy, y^2, x^2y, xy^2, y^3
+*/
+void getPolyTerms(double x, double y, double *terms) {
+	terms[0] = 1;
+	terms[1] = x;
+	terms[2] = y;
+	terms[3] = x * x;
+	terms[4] = x * y;
+	terms[5] = y * y;
+	terms[6] = x * x * y;
+	terms[7] = x * y * y;
+	terms[8] = y * y * y;
+}
+
+/*
+Calculates the modelled photodiode voltages at an angle
+@param model - the model
+@param x - the servo angle
+@param y - the platform angle
+@param volts - receives the four modelled voltages
+*/
+void evalPhotoModel(const photomodel_t *model, float x, float y, voltage_t *volts) {
+	double value[4];
+	double dx;
+	double dy;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		evalPolynomial(model->coef[i], x, y, &value[i], &dx, &dy);
+	volts->volt1 = value[0];
+	volts->volt2 = value[1];
+	volts->volt3 = value[2];
+	volts->volt4 = value[3];
+}
+
+/*
+Calculates continuous angles by inverting the model with Gauss-Newton on the normalized
+voltages, so the result doesn't depend on the overall light intensity. Given a table, the
+reading is dark by the table's own limit, as for getAngles. Without a seed the MODELSTARTS
+closest points of the seed grid are each refined and the best fit is kept, since the fitted
+surfaces fold enough to trap a single start in the wrong basin. That takes about four times
+as long as a seeded call, so a caller tracking the sun should pass the last result.
+@param model - the model
+@param table - the lookup table the model was fitted to, for its dark limit, or NULL for
+DARKSUM
+@param realVolts - the voltage readings
+@param seed - angle to start from, such as the last result, or NULL to use the seed grid
+@param angle - receives the angles
+@return - SUN_OK, SUN_DARK if the reading is dark or SUN_NOMATCH if it is not finite, the
+iteration broke down or even the best fit misses the reading by more than MODELMAXRESIDUAL,
+angle is unchanged unless SUN_OK
+*/
+int getAnglesModel(const photomodel_t *model, const lookup_table_t *table, const voltage_t *realVolts, const anglef_t *seed, anglef_t *angle) {
+	voltage_t norm;
+	double real[4];
+	anglef_t starts[MODELSTARTS];
+	anglef_t best;
+	float startDevs[MODELSTARTS];
+	float current;
+	double residual;
+	double bestResidual = HUGE_VAL;
+	int count = 0;
+	int i;
+	int k;
+
+	if (isBadReading(realVolts))
+		return SUN_NOMATCH;
+	if (table != NULL ? isDark(table, realVolts) : !(realVolts->volt1 + realVolts->volt2 + realVolts->volt3 + realVolts->volt4 > DARKSUM))
+		return SUN_DARK;
+	normalizeVoltage(realVolts, &norm);
+	real[0] = norm.volt1;
+	real[1] = norm.volt2;
+	real[2] = norm.volt3;
+	real[3] = norm.volt4;
+	if (seed != NULL) {
+		starts[0] = *seed;
+		count = 1;
+	}
+	else {
+		// Keep the MODELSTARTS grid points with the lowest deviation, in order
+		for (i = 0; i < SEEDSTEPS * SEEDSTEPS; i++) {
+			current = getNormDeviation(&norm, &model->seedVolts[i]);
+			for (k = count; k > 0 && startDevs[k - 1] > current; k--) {
+				if (k < MODELSTARTS) {
+					startDevs[k] = startDevs[k - 1];
+					starts[k] = starts[k - 1];
+				}
+			}
+			if (k < MODELSTARTS) {
+				startDevs[k] = current;
+				starts[k] = model->seedAngles[i];
+				if (count < MODELSTARTS)
+					count++;
+			}
+		}
+	}
+	for (k = 0; k < count; k++) {
+		residual = refineAngles(model, real, &starts[k]);
+		if (residual < bestResidual) {
+			bestResidual = residual;
+			best = starts[k];
+		}
+		if (bestResidual < MODELTOLERANCE)
+			break;
+	}
+	if (!(bestResidual <= MODELMAXRESIDUAL))
+		return SUN_NOMATCH;
+	*angle = best;
+	return SUN_OK;
+}
+
+/*
+Runs Gauss-Newton from one starting angle
+@param model - the model
+@param real - the normalized voltage reading
+@param angle - the starting angle, replaced by the refined one
+@return - the sum of squared residuals at the refined angle, HUGE_VAL if it broke down
+*/
+static double refineAngles(const photomodel_t *model, const double *real, anglef_t *angle) {
+	double value[4];
+	double dx[4];
+	double dy[4];
+	double sum;
+	double sumX;
+	double sumY;
+	double r;
+	double jx;
+	double jy;
+	double a;
+	double b;
+	double c;
+	double gx;
+	double gy;
+	double det;
+	double stepX;
+	double stepY;
+	double residual = HUGE_VAL;
+	double x = angle->alpha;
+	double y = angle->beta;
+	int iteration;
+	int i;
+
+	for (iteration = 0; iteration <= GNITERATIONS; iteration++) {
+		sum = sumX = sumY = 0;
+		for (i = 0; i < 4; i++) {
+			evalPolynomial(model->coef[i], x, y, &value[i], &dx[i], &dy[i]);
+			sum += value[i];
+			sumX += dx[i];
+			sumY += dy[i];
+		}
+		if (fabs(sum) < 1e-12)
+			return HUGE_VAL;
+		// Residual r_i = m_i / S - v_i and its gradient by the quotient rule
+		a = b = c = gx = gy = residual = 0;
+		for (i = 0; i < 4; i++) {
+			r = value[i] / sum - real[i];
+			jx = (dx[i] * sum - value[i] * sumX) / (sum * sum);
+			jy = (dy[i] * sum - value[i] * sumY) / (sum * sum);
+			a += jx * jx;
+			b += jx * jy;
+			c += jy * jy;
+			gx += jx * r;
+			gy += jy * r;
+			residual += r * r;
+		}
+		det = a * c - b * b;
+		if (iteration == GNITERATIONS || fabs(det) < 1e-18)
+			break;
+		stepX = -(c * gx - b * gy) / det;
+		stepY = -(a * gy - b * gx) / det;
+		if (fabs(stepX) < GNTOLERANCE && fabs(stepY) < GNTOLERANCE)
+			break;
+		// Keep to the domain the polynomials were fitted over
+		x += stepX;
+		y += stepY;
+		x = x < model->xMin ? model->xMin : (x > model->xMax ? model->xMax : x);
+		y = y < model->yMin ? model->yMin : (y > model->yMax ? model->yMax : y);
+	}
+	angle->alpha = x;
+	angle->beta = y;
+	return residual;
+}
+
+/*
+Pre-evaluates the normalized model on the coarse grid used to seed Gauss-Newton
+@param model - the model with its coefficients and domain filled in
+*/
+static void seedPhotoModel(photomodel_t *model) {
+	int i;
+	int j;
+	int k;
+
+	for (i = 0; i < SEEDSTEPS; i++) {
+		for (j = 0; j < SEEDSTEPS; j++) {
+			k = i * SEEDSTEPS + j;
+			model->seedAngles[k].alpha = model->xMin + (model->xMax - model->xMin) * j / (SEEDSTEPS - 1);
+			model->seedAngles[k].beta = model->yMin + (model->yMax - model->yMin) * i / (SEEDSTEPS - 1);
+			evalPhotoModel(model, model->seedAngles[k].alpha, model->seedAngles[k].beta, &model->seedVolts[k]);
+			normalizeVoltage(&model->seedVolts[k], &model->seedVolts[k]);
+		}
+	}
+}
+
+/*
+Evaluates one poly23 surface and its partial derivatives
+@param p - the POLYTERMS coefficients p00 p10 p01 p20 p11 p02 p21 p12 p03
+@param x - the servo angle
+@param y - the platform angle
+@param value - receives the surface value
+@param dx - receives the derivative by x
+@param dy - receives the derivative by y
+*/
+static void evalPolynomial(const double *p, double x, double y, double *value, double *dx, double *dy) {
+	*value = p[0] + p[1] * x + p[2] * y + p[3] * x * x + p[4] * x * y + p[5] * y * y +
+		p[6] * x * x * y + p[7] * x * y * y + p[8] * y * y * y;
+	*dx = p[1] + 2 * p[3] * x + p[4] * y + 2 * p[6] * x * y + p[7] * y * y;
+	*dy = p[2] + p[4] * x + 2 * p[5] * y + p[6] * x * x + 2 * p[7] * x * y + 3 * p[8] * y * y;
+}
@@ -0,0 +1,37 @@
+#ifndef PHOTOMODEL_H
+#define PHOTOMODEL_H
+
+#include "calculations.h"
+
+#define MODELFILE "poly23.txt"
+// Terms of a MATLAB poly23 surface: p00 p10 p01 p20 p11 p02 p21 p12 p03
+#define POLYTERMS 9
+// The coarse seed grid is SEEDSTEPS x SEEDSTEPS points over the fitted domain
+#define SEEDSTEPS 9
+#define GNITERATIONS 6
+// Seed grid points refined when no seed is given
+#define MODELSTARTS 3
+
+// The four photodiode voltages modelled as poly23 surfaces over x (servo) and y (platform)
+// angle, as fitted by PlotVoltageFit.m, with the model pre-evaluated on a coarse seed grid
+typedef struct photomodel_s {
+	double coef[4][POLYTERMS];
+	float xMin;
+	float xMax;
+	float yMin;
+	float yMax;
+	voltage_t seedVolts[SEEDSTEPS * SEEDSTEPS];
+	anglef_t seedAngles[SEEDSTEPS * SEEDSTEPS];
+} photomodel_t;
+
+int loadPhotoModel(photomodel_t *model, const char *filename);
+
+int writePhotoModel(const photomodel_t *model, const char *filename, const char *comment);
+
+void getPolyTerms(double x, double y, double *terms);
+
+void evalPhotoModel(const photomodel_t *model, float x, float y, voltage_t *volts);
+
+int getAnglesModel(const photomodel_t *model, const lookup_table_t *table, const voltage_t *realVolts, const anglef_t *seed, anglef_t *angle);
+
+#endif
@@ -0,0 +1,272 @@
+#include "quant_table.h"
+#include "interpolate.h"
+#include <string.h>
+
+_Static_assert(sizeof(quant_row_t) == 10, "quantized rows must stay 10 bytes");
+
+static int isQuantHole(const quant_row_t *row);
+
+/*
+Makes a quantized copy of a loaded table, with the rows laid out in grid order and the
+table's dark limit
+@param quant - the table to fill, should be released with freeQuantTable
+@param table - a loaded table whose angles fit in int8
+@return - 0 on success, -1 if out of memory or an angle does not fit
+*/
+int quantizeTable(quant_table_t *quant, const lookup_table_t *table) {
+	size_t cells = (size_t)table->servoCount * table->platCount;
+	quant_row_t *rows;
+	voltage_t norm;
+	size_t i;
+	int row;
+
+	memset(quant, 0, sizeof(quant_table_t));
+	if (table->servoMin < INT8_MIN || table->servoMin + table->servoCount - 1 > INT8_MAX ||
+			table->platMin < INT8_MIN || table->platMin + table->platCount - 1 > INT8_MAX)
+		return -1;
+	// Never ask for zero bytes so an empty table still gets valid storage
+	rows = malloc((cells + 1) * sizeof(quant_row_t));
+	if (rows == NULL)
+		return -1;
+	for (i = 0; i < cells; i++) {
+		rows[i].servo = table->servoMin + (int)(i % table->servoCount);
+		rows[i].plat = table->platMin + (int)(i / table->servoCount);
+		row = table->grid[i];
+		if (row < 0) {
+			rows[i].volt[0] = rows[i].volt[1] = rows[i].volt[2] = rows[i].volt[3] = QHOLE;
+			continue;
+		}
+		getTableVoltage(table, row, &norm);
+		quantizeVoltage(&norm, rows[i].volt);
+	}
+	quant->rows = rows;
+	quant->storage = rows;
+	quant->count = cells;
+	quant->servoMin = table->servoMin;
+	quant->platMin = table->platMin;
+	quant->servoCount = table->servoCount;
+	quant->platCount = table->platCount;
+	setQuantDarkSum(quant, table->darkSum);
+	return 0;
+}
+
+/*
+Releases the memory held by a quantized table
+@param quant - a table filled by quantizeTable or initStaticQuantTable
+*/
+void freeQuantTable(quant_table_t *quant) {
+	free(quant->storage);
+	memset(quant, 0, sizeof(quant_table_t));
+}
+
+/*
+Sets when a reading counts as no sun, like setMatchLimits for a loaded table
+@param quant - the quantized table
+@param darkSum - readings whose four counts sum to no more than this are dark. Counts are
+whole, so this is rounded down, and a sum of zero is always dark as it has no ratios.
+*/
+void setQuantDarkSum(quant_table_t *quant, float darkSum) {
+	if (!(darkSum > 0))
+		quant->darkSum = 0;
+	else if (darkSum >= 4.0f * UINT16_MAX)
+		quant->darkSum = 4u * UINT16_MAX;
+	else
+		quant->darkSum = (uint32_t)darkSum;
+}
+
+/*
+Normalizes raw ADC counts into quantized ratios with integer arithmetic only
+@param counts - the four photodiode readings
+@param ratio - receives each count divided by the sum, rounded, scaled by QONE. All zero
+if every count is zero.
+*/
+void quantizeCounts(const uint16_t counts[4], uint16_t ratio[4]) {
+	uint32_t sum = (uint32_t)counts[0] + counts[1] + counts[2] + counts[3];
+	int i;
+
+	// count * QONE + sum / 2 stays within 32 bits for any four 16 bit counts
+	for (i = 0; i < 4; i++)
+		ratio[i] = sum != 0 ? ((uint32_t)counts[i] * QONE + sum / 2) / sum : 0;
+}
+
+/*
+Quantizes a normalized float reading, for hosts that already have one
+@param norm - the normalized voltages
+@param ratio - receives each ratio scaled by QONE and rounded
+*/
+void quantizeVoltage(const voltage_t *norm, uint16_t ratio[4]) {
+	const float volts[4] = { norm->volt1, norm->volt2, norm->volt3, norm->volt4 };
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		if (!(volts[i] > 0))
+			ratio[i] = 0;
+		else if (volts[i] >= 1)
+			ratio[i] = QONE;
+		else
+			ratio[i] = (uint16_t)(volts[i] * QONE + 0.5f);
+	}
+}
+
+/*
+Finds the quantized row with the lowest deviation, using integer arithmetic only. Ties go
+to the first row, as in the float scan.
+@param quant - the quantized table
+@param ratio - the quantized reading
+@param bestDev - receives the lowest deviation, in units of 1 / QONE
+@return - the index of the best row, or quant->count for an empty table
+*/
+size_t findBestQuantRow(const quant_table_t *quant, const uint16_t ratio[4], uint32_t *bestDev) {
+	const quant_row_t *row;
+	uint32_t best = UINT32_MAX;
+	uint32_t dev;
+	size_t bestRow = quant->count;
+	size_t i;
+	int32_t d0;
+	int32_t d1;
+	int32_t d2;
+	int32_t d3;
+
+	for (i = 0; i < quant->count; i++) {
+		row = &quant->rows[i];
+		d0 = (int32_t)row->volt[0] - ratio[0];
+		d1 = (int32_t)row->volt[1] - ratio[1];
+		d2 = (int32_t)row->volt[2] - ratio[2];
+		d3 = (int32_t)row->volt[3] - ratio[3];
+		dev = (uint32_t)(d0 < 0 ? -d0 : d0) + (uint32_t)(d1 < 0 ? -d1 : d1) +
+			(uint32_t)(d2 < 0 ? -d2 : d2) + (uint32_t)(d3 < 0 ? -d3 : d3);
+		if (dev < best) {
+			best = dev;
+			bestRow = i;
+		}
+	}
+	*bestDev = best;
+	return bestRow;
+}
+
+/*
+Calculates the best angle from raw ADC counts with no floating point at all
+@param quant - the quantized table
+@param counts - the four photodiode readings
+@param angle - receives the angle of the best row
+@return - SUN_OK, SUN_DARK if the counts sum to no more than the table's darkSum or
+SUN_NOMATCH if the table is empty
+*/
+int getAnglesQuant(const quant_table_t *quant, const uint16_t counts[4], angle_t *angle) {
+	uint16_t ratio[4];
+	uint32_t best;
+	size_t row;
+
+	if ((uint32_t)counts[0] + counts[1] + counts[2] + counts[3] <= quant->darkSum)
+		return SUN_DARK;
+	quantizeCounts(counts, ratio);
+	row = findBestQuantRow(quant, ratio, &best);
+	if (row >= quant->count)
+		return SUN_NOMATCH;
+	angle->alpha = quant->rows[row].servo;
+	angle->beta = quant->rows[row].plat;
+	return SUN_OK;
+}
+
+/*
+Finds the quantized row of a servo/platform angle
+@param quant - the quantized table
+@param servo - the servo angle
+@param plat - the platform angle
+@return - the row index, or -1 if the angle is outside the grid or was never recorded
+*/
+int getQuantRow(const quant_table_t *quant, int servo, int plat) {
+	int row;
+
+	servo -= quant->servoMin;
+	plat -= quant->platMin;
+	if (servo < 0 || servo >= quant->servoCount || plat < 0 || plat >= quant->platCount)
+		return -1;
+	row = plat * quant->servoCount + servo;
+	return isQuantHole(&quant->rows[row]) ? -1 : row;
+}
+
+/*
+Calculates sub-degree angles from raw ADC counts by finding the best match and
+interpolating around it, with no floating point at all
+@param quant - the quantized table
+@param counts - the four photodiode readings
+@param angle - receives the interpolated angles, unchanged if nothing matched
+@return - the deviation of the best match in ratio steps, UINT32_MAX if nothing matched or
+the counts sum to no more than the table's darkSum
+*/
+uint32_t getAnglesInterpQuant(const quant_table_t *quant, const uint16_t counts[4], anglefx_t *angle) {
+	uint16_t ratio[4];
+	uint32_t best;
+	size_t row;
+
+	if ((uint32_t)counts[0] + counts[1] + counts[2] + counts[3] <= quant->darkSum)
+		return UINT32_MAX;
+	quantizeCounts(counts, ratio);
+	row = findBestQuantRow(quant, ratio, &best);
+	if (row >= quant->count)
+		return UINT32_MAX;
+	interpolateAnglesQuant(quant, ratio, row, angle);
+	return best;
+}
+
+/*
+Blends the angles of the grid cells around a match like interpolateAngles, in integers.
+Each weight is the square of QWEIGHTONE / (deviation + QEPSILON), and the angles are
+blended as offsets from the best cell, which keeps every sum within 32 bits until the last
+division.
+@param quant - the quantized table
+@param ratio - the quantized reading
+@param bestRow - the row that matched best
+@param angle - receives the interpolated angles
+@return - the sum of the weights
+*/
+uint32_t interpolateAnglesQuant(const quant_table_t *quant, const uint16_t ratio[4], size_t bestRow, anglefx_t *angle) {
+	const quant_row_t *best = &quant->rows[bestRow];
+	const quant_row_t *cell;
+	uint32_t current;
+	uint32_t inverse;
+	uint32_t weight;
+	uint32_t total = 0;
+	int32_t alpha = 0;
+	int32_t beta = 0;
+	int32_t d;
+	int servo;
+	int plat;
+	int row;
+	int i;
+
+	for (plat = -INTERPRADIUS; plat <= INTERPRADIUS; plat++) {
+		for (servo = -INTERPRADIUS; servo <= INTERPRADIUS; servo++) {
+			row = getQuantRow(quant, best->servo + servo, best->plat + plat);
+			if (row < 0)
+				continue;
+			cell = &quant->rows[row];
+			current = QEPSILON;
+			for (i = 0; i < 4; i++) {
+				d = (int32_t)cell->volt[i] - ratio[i];
+				current += d < 0 ? -d : d;
+			}
+			inverse = (QWEIGHTONE + current / 2) / current;
+			weight = inverse * inverse;
+			total += weight;
+			alpha += (int32_t)weight * servo;
+			beta += (int32_t)weight * plat;
+		}
+	}
+	// The best row itself is always in the neighbourhood, so total is never zero
+	angle->alpha = best->servo * QANGLEONE + (int32_t)(((int64_t)alpha * QANGLEONE) / total);
+	angle->beta = best->plat * QANGLEONE + (int32_t)(((int64_t)beta * QANGLEONE) / total);
+	return total;
+}
+
+/*
+Tells whether a row stands for a cell the sweep never visited. A real row's ratios sum to
+about QONE, so it can have QHOLE in one channel when all its light falls there, but never
+in all four.
+@param row - the row
+@return - 1 for a hole, otherwise 0
+*/
+static int isQuantHole(const quant_row_t *row) {
+	return row->volt[0] == QHOLE && row->volt[1] == QHOLE && row->volt[2] == QHOLE && row->volt[3] == QHOLE;
+}
@@ -0,0 +1,81 @@
+#ifndef QUANT_TABLE_H
+#define QUANT_TABLE_H
+
+#include <stdint.h>
+#include "calculations.h"
+
+// Normalized ratios are stored as unsigned fixed point, QONE standing for a ratio of 1
+#define QONE 65535u
+#define QSHIFT 16
+// Each ratio is off by at most half a step in the table and half in the reading, so a
+// quantized match can only differ from the float one among rows whose float deviations
+// are within QTOLERANCE of each other
+#define QTOLERANCE (8.0f / QONE)
+// All four ratios of a grid cell the sweep never visited. Its deviation from any reading is
+// at least 3 * QONE, more than any real row can reach, so it never matches. QHOLE is also
+// the ratio of a channel holding all the light, so only a row with it in every channel is
+// a hole.
+#define QHOLE 0xffffu
+// Interpolated angles are signed Q16 degrees
+#define QANGLEONE 65536
+// INTERPEPSILON in ratio steps
+#define QEPSILON 655
+// Interpolation weights are (QWEIGHTONE / (deviation + QEPSILON)) squared, which keeps every
+// sum over the neighbourhood within 32 bits
+#define QWEIGHTONE (1u << 20)
+// Worst difference seen between interpolateAnglesQuant and the float interpolateAngles on the
+// recorded tables, in degrees, when both start from the same best match
+#define QANGLETOLERANCE 0.02f
+
+// One row of a quantized table, 10 bytes: the angles in whole degrees and the four
+// normalized ratios scaled by QONE
+typedef struct quant_row_s {
+	int8_t servo;
+	int8_t plat;
+	uint16_t volt[4];
+} quant_row_t;
+
+// Sub-degree angles from the fixed point interpolation, in QANGLEONE units
+typedef struct anglefx_s {
+	int32_t alpha;
+	int32_t beta;
+} anglefx_t;
+
+// A lookup table in quantized rows, for targets where flash is tight. rows is either
+// storage, allocated by quantizeTable, or const data linked in at build time. The rows
+// cover the whole servoCount x platCount grid in order, platform-major, so the row of an
+// angle is calculated rather than stored; cells missing from the sweep are QHOLE rows.
+// Readings whose four counts sum to no more than darkSum are dark, as with the table's
+// darkSum in calculations.h.
+typedef struct quant_table_s {
+	const quant_row_t *rows;
+	size_t count;
+	quant_row_t *storage;
+	int servoMin;
+	int platMin;
+	int servoCount;
+	int platCount;
+	uint32_t darkSum;
+} quant_table_t;
+
+int quantizeTable(quant_table_t *quant, const lookup_table_t *table);
+
+void freeQuantTable(quant_table_t *quant);
+
+void setQuantDarkSum(quant_table_t *quant, float darkSum);
+
+void quantizeCounts(const uint16_t counts[4], uint16_t ratio[4]);
+
+void quantizeVoltage(const voltage_t *norm, uint16_t ratio[4]);
+
+size_t findBestQuantRow(const quant_table_t *quant, const uint16_t ratio[4], uint32_t *bestDev);
+
+int getAnglesQuant(const quant_table_t *quant, const uint16_t counts[4], angle_t *angle);
+
+int getQuantRow(const quant_table_t *quant, int servo, int plat);
+
+uint32_t getAnglesInterpQuant(const quant_table_t *quant, const uint16_t counts[4], anglefx_t *angle);
+
+uint32_t interpolateAnglesQuant(const quant_table_t *quant, const uint16_t ratio[4], size_t bestRow, anglefx_t *angle);
+
+#endif
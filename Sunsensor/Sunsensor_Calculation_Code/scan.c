@@ -0,0 +1,210 @@
+#include "scan.h"
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+Scans the whole table for the best row, the same row findBestRowScalar gives
+@param table - the lookup table
+@param norm - the normalized voltage reading
+@param bestDev - receives the lowest deviation found
+@return - the index of the best row, or table->count if no row is under MAXVOLTDIFF
+*/
+size_t findBestRow(const lookup_table_t *table, const voltage_t *norm, float *bestDev) {
+	return findGoodRow(table, norm, 0, bestDev);
+}
+
+#if defined(__AVX2__)
+/*
+Scans the table 8 rows at a time with AVX2, keeping a best deviation and row per lane, and
+stops once some lane is under goodEnough
+@param table - the lookup table
+@param norm - the normalized voltage reading
+@param goodEnough - deviation low enough to stop at, 0 to scan every row
+@param bestDev - receives the deviation of the row returned
+@return - the index of the best row seen, or table->count if no row is under MAXVOLTDIFF
+*/
+size_t findGoodRow(const lookup_table_t *table, const voltage_t *norm, float goodEnough, float *bestDev) {
+	const __m256 good = _mm256_set1_ps(goodEnough);
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	const __m256 q1 = _mm256_set1_ps(norm->volt1);
+	const __m256 q2 = _mm256_set1_ps(norm->volt2);
+	const __m256 q3 = _mm256_set1_ps(norm->volt3);
+	const __m256 q4 = _mm256_set1_ps(norm->volt4);
+	const __m256i step = _mm256_set1_epi32(8);
+	__m256 bestLane = _mm256_set1_ps(MAXVOLTDIFF);
+	__m256i bestRowLane = _mm256_set1_epi32(-1);
+	__m256i rowLane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256 dev;
+	__m256 less;
+	float devs[8];
+	int rows[8];
+	float best = MAXVOLTDIFF;
+	size_t bestRow = table->count;
+	size_t i;
+
+	for (i = 0; i < table->padded; i += 8) {
+		dev = _mm256_and_ps(_mm256_sub_ps(_mm256_load_ps(table->volt1 + i), q1), absMask);
+		dev = _mm256_add_ps(dev, _mm256_and_ps(_mm256_sub_ps(_mm256_load_ps(table->volt2 + i), q2), absMask));
+		dev = _mm256_add_ps(dev, _mm256_and_ps(_mm256_sub_ps(_mm256_load_ps(table->volt3 + i), q3), absMask));
+		dev = _mm256_add_ps(dev, _mm256_and_ps(_mm256_sub_ps(_mm256_load_ps(table->volt4 + i), q4), absMask));
+		less = _mm256_cmp_ps(dev, bestLane, _CMP_LT_OQ);
+		bestLane = _mm256_blendv_ps(bestLane, dev, less);
+		bestRowLane = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(bestRowLane), _mm256_castsi256_ps(rowLane), less));
+		rowLane = _mm256_add_epi32(rowLane, step);
+		if ((i + 8) % EXITROWS == 0 && _mm256_movemask_ps(_mm256_cmp_ps(bestLane, good, _CMP_LT_OQ)) != 0)
+			break;
+	}
+
+	// Each lane saw its rows in order, so ties between lanes go to the lowest row
+	_mm256_storeu_ps(devs, bestLane);
+	_mm256_storeu_si256((__m256i *)rows, bestRowLane);
+	for (i = 0; i < 8; i++) {
+		if (rows[i] < 0)
+			continue;
+		if (devs[i] < best || (devs[i] == best && (size_t)rows[i] < bestRow)) {
+			best = devs[i];
+			bestRow = rows[i];
+		}
+	}
+	*bestDev = best;
+	return bestRow;
+}
+#elif defined(__SSE2__)
+/*
+Scans the table 4 rows at a time with SSE2, keeping a best deviation and row per lane, and
+stops once some lane is under goodEnough
+@param table - the lookup table
+@param norm - the normalized voltage reading
+@param goodEnough - deviation low enough to stop at, 0 to scan every row
+@param bestDev - receives the deviation of the row returned
+@return - the index of the best row seen, or table->count if no row is under MAXVOLTDIFF
+*/
+size_t findGoodRow(const lookup_table_t *table, const voltage_t *norm, float goodEnough, float *bestDev) {
+	const __m128 good = _mm_set1_ps(goodEnough);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 q1 = _mm_set1_ps(norm->volt1);
+	const __m128 q2 = _mm_set1_ps(norm->volt2);
+	const __m128 q3 = _mm_set1_ps(norm->volt3);
+	const __m128 q4 = _mm_set1_ps(norm->volt4);
+	const __m128i step = _mm_set1_epi32(4);
+	__m128 bestLane = _mm_set1_ps(MAXVOLTDIFF);
+	__m128i bestRowLane = _mm_set1_epi32(-1);
+	__m128i rowLane = _mm_setr_epi32(0, 1, 2, 3);
+	__m128 dev;
+	__m128 less;
+	float devs[4];
+	int rows[4];
+	float best = MAXVOLTDIFF;
+	size_t bestRow = table->count;
+	size_t i;
+
+	for (i = 0; i < table->padded; i += 4) {
+		dev = _mm_and_ps(_mm_sub_ps(_mm_load_ps(table->volt1 + i), q1), absMask);
+		dev = _mm_add_ps(dev, _mm_and_ps(_mm_sub_ps(_mm_load_ps(table->volt2 + i), q2), absMask));
+		dev = _mm_add_ps(dev, _mm_and_ps(_mm_sub_ps(_mm_load_ps(table->volt3 + i), q3), absMask));
+		dev = _mm_add_ps(dev, _mm_and_ps(_mm_sub_ps(_mm_load_ps(table->volt4 + i), q4), absMask));
+		less = _mm_cmplt_ps(dev, bestLane);
+		bestLane = _mm_or_ps(_mm_and_ps(less, dev), _mm_andnot_ps(less, bestLane));
+		bestRowLane = _mm_or_si128(_mm_and_si128(_mm_castps_si128(less), rowLane), _mm_andnot_si128(_mm_castps_si128(less), bestRowLane));
+		rowLane = _mm_add_epi32(rowLane, step);
+		if ((i + 4) % EXITROWS == 0 && _mm_movemask_ps(_mm_cmplt_ps(bestLane, good)) != 0)
+			break;
+	}
+
+	// Each lane saw its rows in order, so ties between lanes go to the lowest row
+	_mm_storeu_ps(devs, bestLane);
+	_mm_storeu_si128((__m128i *)rows, bestRowLane);
+	for (i = 0; i < 4; i++) {
+		if (rows[i] < 0)
+			continue;
+		if (devs[i] < best || (devs[i] == best && (size_t)rows[i] < bestRow)) {
+			best = devs[i];
+			bestRow = rows[i];
+		}
+	}
+	*bestDev = best;
+	return bestRow;
+}
+#else
+/*
+Scans the table one row at a time where no SIMD is available, stopping at the first row
+under goodEnough
+@param table - the lookup table
+@param norm - the normalized voltage reading
+@param goodEnough - deviation low enough to stop at, 0 to scan every row
+@param bestDev - receives the deviation of the row returned
+@return - the index of the best row seen, or table->count if no row is under MAXVOLTDIFF
+*/
+size_t findGoodRow(const lookup_table_t *table, const voltage_t *norm, float goodEnough, float *bestDev) {
+	float best = MAXVOLTDIFF;
+	float current;
+	size_t bestRow = table->count;
+	size_t i;
+
+	for (i = 0; i < table->count && !(best < goodEnough); i++) {
+		current =
+			fabsf(table->volt1[i] - norm->volt1) +
+			fabsf(table->volt2[i] - norm->volt2) +
+			fabsf(table->volt3[i] - norm->volt3) +
+			fabsf(table->volt4[i] - norm->volt4);
+		if (current < best) {
+			bestRow = i;
+			best = current;
+		}
+	}
+	*bestDev = best;
+	return bestRow;
+}
+#endif
+
+/*
+Scans the table one row at a time, used where no SIMD is available and to check the SIMD scan
+@param table - the lookup table
+@param norm - the normalized voltage reading
+@param bestDev - receives the lowest deviation found
+@return - the index of the best row, or table->count if no row is under MAXVOLTDIFF
+*/
+size_t findBestRowScalar(const lookup_table_t *table, const voltage_t *norm, float *bestDev) {
+	float best = MAXVOLTDIFF;
+	float current;
+	size_t bestRow = table->count;
+	size_t i;
+
+	for (i = 0; i < table->count; i++) {
+		current =
+			fabsf(table->volt1[i] - norm->volt1) +
+			fabsf(table->volt2[i] - norm->volt2) +
+			fabsf(table->volt3[i] - norm->volt3) +
+			fabsf(table->volt4[i] - norm->volt4);
+		// replace the best row if it has a lower deviation
+		if (current < best) {
+			bestRow = i;
+			best = current;
+		}
+	}
+	*bestDev = best;
+	return bestRow;
+}
+
+/*
+Scans the table one row at a time for the candidates of the best and second match
+@param table - the lookup table
+@param norm - the normalized voltage reading
+@param kept - receives the candidates
+*/
+void findMatchRowsScalar(const lookup_table_t *table, const voltage_t *norm, match_rows_t *kept) {
+	float current;
+	size_t i;
+
+	kept->found = 0;
+	kept->bound = MAXVOLTDIFF;
+	for (i = 0; i < table->count; i++) {
+		current =
+			fabsf(table->volt1[i] - norm->volt1) +
+			fabsf(table->volt2[i] - norm->volt2) +
+			fabsf(table->volt3[i] - norm->volt3) +
+			fabsf(table->volt4[i] - norm->volt4);
+		keepMatchRow(table, kept, i, current);
+	}
+}
@@ -0,0 +1,17 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include "calculations.h"
+
+// The SIMD scan checks the good enough limit once per this many rows
+#define EXITROWS 64
+
+size_t findGoodRow(const lookup_table_t *table, const voltage_t *norm, float goodEnough, float *bestDev);
+
+size_t findBestRow(const lookup_table_t *table, const voltage_t *norm, float *bestDev);
+
+size_t findBestRowScalar(const lookup_table_t *table, const voltage_t *norm, float *bestDev);
+
+void findMatchRowsScalar(const lookup_table_t *table, const voltage_t *norm, match_rows_t *kept);
+
+#endif
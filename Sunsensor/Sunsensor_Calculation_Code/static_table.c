@@ -0,0 +1,43 @@
+#include "static_table.h"
+#include "kdtree.h"
+#include "lookup_data.h"
+#include "lookup_qdata.h"
+#include <string.h>
+
+_Static_assert(sizeof(staticTable) == STATICSIZE, "generated table layout must match the table columns");
+
+/*
+Sets up a table over the const data generated from lookup.txt at build time, with no file I/O
+@param table - the table to fill, should be released with freeLookupTable
+@return - 0 on success, -1 if out of memory for the angle grid
+*/
+int initStaticTable(lookup_table_t *table) {
+	memset(table, 0, sizeof(lookup_table_t));
+	table->count = STATICCOUNT;
+	table->padded = STATICPADDED;
+	table->storage = (void *)&staticTable;
+	table->storageSize = sizeof(staticTable);
+	table->storageKind = TABLE_STATIC;
+	// The columns and tree are only ever read, so dropping const here is safe
+	setTableColumns(table, (void *)staticTable.servo);
+	table->index = viewKdTree((void *)staticTable.points, STATICCOUNT);
+	if (table->index == NULL)
+		return -1;
+	return indexLookupTable(table);
+}
+
+/*
+Sets up a quantized table over the const rows generated from lookup.txt at build time, with
+the default dark limit as initStaticTable has
+@param quant - the table to fill, freeQuantTable releases nothing for it
+*/
+void initStaticQuantTable(quant_table_t *quant) {
+	quant->rows = staticQuantRows;
+	quant->count = STATICQCOUNT;
+	quant->storage = NULL;
+	quant->servoMin = STATICQSERVOMIN;
+	quant->platMin = STATICQPLATMIN;
+	quant->servoCount = STATICQSERVOCOUNT;
+	quant->platCount = STATICQPLATCOUNT;
+	setQuantDarkSum(quant, DARKSUM);
+}
@@ -0,0 +1,11 @@
+#ifndef STATIC_TABLE_H
+#define STATIC_TABLE_H
+
+#include "calculations.h"
+#include "quant_table.h"
+
+int initStaticTable(lookup_table_t *table);
+
+void initStaticQuantTable(quant_table_t *quant);
+
+#endif
@@ -0,0 +1,123 @@
+#include "sun_heads.h"
+#include "interpolate.h"
+#include <string.h>
+
+/*
+Sets up an empty set of heads
+@param heads - the set to set up
+*/
+void initSunHeads(sun_heads_t *heads) {
+	heads->count = 0;
+	heads->maxDev = HEADMAXDEV;
+}
+
+/*
+Adds one more head over a table that is already set up, from initStaticTable on a flight
+build or loadLookupTable on the ground, and works out the directions of its rows
+@param heads - the set to add to
+@param table - the table of the head, taken over by the set on success so that only
+freeSunHeads releases it, left to the caller on failure
+@param rotation - the mounting of the head, head frame to body frame
+@return - the index of the new head, or -1 if the set is full or out of memory
+*/
+int addSunHead(sun_heads_t *heads, const lookup_table_t *table, const double rotation[3][3]) {
+	sun_head_t *head;
+
+	if (heads->count >= MAXHEADS)
+		return -1;
+	head = &heads->heads[heads->count];
+	if (initVectorTable(&head->vectors, table) != 0)
+		return -1;
+	head->table = *table;
+	memcpy(head->rotation, rotation, sizeof(head->rotation));
+	return heads->count++;
+}
+
+/*
+Releases the tables of every head
+@param heads - the set to release
+*/
+void freeSunHeads(sun_heads_t *heads) {
+	int i;
+
+	for (i = 0; i < heads->count; i++) {
+		freeLookupTable(&heads->heads[i].table);
+		freeVectorTable(&heads->heads[i].vectors);
+	}
+	heads->count = 0;
+}
+
+/*
+Gives the mounting rotation of a head looking out of one face of the body. Heads on the
+x and y faces are turned about the body y and x axes, the -z head about x.
+@param face - one of the FACE_ values
+@param rotation - receives the rotation, head frame to body frame, unchanged on failure
+@return - 0 on success, -1 if face is not one of the FACE_ values
+*/
+int getFaceRotation(int face, double rotation[3][3]) {
+	static const double faces[6][3][3] = {
+		{ { 0, 0, 1 }, { 0, 1, 0 }, { -1, 0, 0 } },
+		{ { 0, 0, -1 }, { 0, 1, 0 }, { 1, 0, 0 } },
+		{ { 1, 0, 0 }, { 0, 0, 1 }, { 0, -1, 0 } },
+		{ { 1, 0, 0 }, { 0, 0, -1 }, { 0, 1, 0 } },
+		{ { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } },
+		{ { 1, 0, 0 }, { 0, -1, 0 }, { 0, 0, -1 } }
+	};
+
+	if (face < FACE_PX || face > FACE_NZ)
+		return -1;
+	memcpy(rotation, faces[face], sizeof(faces[face]));
+	return 0;
+}
+
+/*
+Calculates the body frame sun direction from one reading of every head in a single pass.
+Each head that is lit and matches within maxDev gives a direction interpolated from the
+directions of its rows, and these are averaged weighted by the inverse squared deviation of the match.
+@param heads - the set of heads
+@param realVolts - one reading per head, in the order they were added
+@param sun - receives the unit sun vector in the body frame, unchanged unless SUN_OK
+@param devs - receives the deviation of each head, MAXVOLTDIFF for heads left out, or NULL
+@return - SUN_OK, SUN_DARK if every head's reading is dark by its own table's limit, or
+SUN_NOMATCH if no lit head matched within maxDev or their directions cancelled out
+*/
+int getSunVector(const sun_heads_t *heads, const voltage_t *realVolts, sun_vector_t *sun, float *devs) {
+	const sun_head_t *head;
+	double total[3] = { 0, 0, 0 };
+	sun_vector_t vector;
+	double weight;
+	double length;
+	float dev;
+	int lit = 0;
+	int used = 0;
+	int i;
+	int j;
+
+	for (i = 0; i < heads->count; i++) {
+		head = &heads->heads[i];
+		lit += !isDark(&head->table, &realVolts[i]);
+		dev = getSensorVector(&head->table, &head->vectors, &realVolts[i], &vector);
+		if (!(dev <= heads->maxDev))
+			dev = MAXVOLTDIFF;
+		if (devs != NULL)
+			devs[i] = dev;
+		if (dev == MAXVOLTDIFF)
+			continue;
+		weight = 1 / ((dev + INTERPEPSILON) * (dev + INTERPEPSILON));
+		for (j = 0; j < 3; j++)
+			total[j] += weight * (head->rotation[j][0] * vector.x + head->rotation[j][1] * vector.y + head->rotation[j][2] * vector.z);
+		used++;
+	}
+	if (lit == 0)
+		return SUN_DARK;
+	if (used == 0)
+		return SUN_NOMATCH;
+	length = sqrt(total[0] * total[0] + total[1] * total[1] + total[2] * total[2]);
+	// Heads on opposite faces can cancel out, which leaves no direction to give
+	if (!(length > 0))
+		return SUN_NOMATCH;
+	sun->x = total[0] / length;
+	sun->y = total[1] / length;
+	sun->z = total[2] / length;
+	return SUN_OK;
+}
@@ -0,0 +1,45 @@
+#ifndef SUN_HEADS_H
+#define SUN_HEADS_H
+
+#include "calculations.h"
+#include "sun_vector.h"
+
+// Most sensor heads one set can hold, one per face of the satellite
+#define MAXHEADS 6
+// Heads whose best match deviates more than this are left out of the sun vector
+#define HEADMAXDEV 0.1f
+
+// Faces a head can be mounted on, see getFaceRotation
+#define FACE_PX 0
+#define FACE_NX 1
+#define FACE_PY 2
+#define FACE_NY 3
+#define FACE_PZ 4
+#define FACE_NZ 5
+
+// One four diode sensor head with its own table and the directions of its rows. rotation
+// takes a direction in the head frame, see sun_vector_t, to the body frame.
+typedef struct sun_head_s {
+	lookup_table_t table;
+	vector_table_t vectors;
+	double rotation[3][3];
+} sun_head_t;
+
+// Every head on the satellite, loaded once and queried together each cycle
+typedef struct sun_heads_s {
+	sun_head_t heads[MAXHEADS];
+	int count;
+	float maxDev;
+} sun_heads_t;
+
+void initSunHeads(sun_heads_t *heads);
+
+int addSunHead(sun_heads_t *heads, const lookup_table_t *table, const double rotation[3][3]);
+
+void freeSunHeads(sun_heads_t *heads);
+
+int getFaceRotation(int face, double rotation[3][3]);
+
+int getSunVector(const sun_heads_t *heads, const voltage_t *realVolts, sun_vector_t *sun, float *devs);
+
+#endif
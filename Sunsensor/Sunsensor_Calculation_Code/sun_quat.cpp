@@ -0,0 +1,42 @@
+#include "sun_quat.h"
+
+using namespace Quaternion;
+
+/*
+Turns a sun vector into the pure quaternion 0 + xi + yj + zk
+@param vector - the sun vector
+@return - the quaternion
+*/
+quat getSunQuat(const sun_vector_t &vector)
+{
+	return quat(0, vector.x, vector.y, vector.z);
+}
+
+/*
+Takes the vector part of a quaternion as a sun vector
+@param q - the quaternion, normally a pure one
+@return - the sun vector
+*/
+sun_vector_t getQuatSunVector(const quat &q)
+{
+	sun_vector_t vector;
+
+	vector.x = q.b;
+	vector.y = q.c;
+	vector.z = q.d;
+	return vector;
+}
+
+/*
+Rotates a sun vector by a unit quaternion, q * v * q', such as a head or body frame vector
+into the frame the attitude estimate is kept in
+@param rotation - the unit quaternion of the rotation
+@param vector - the sun vector
+@return - the rotated sun vector
+*/
+sun_vector_t rotateSunVector(const quat &rotation, const sun_vector_t &vector)
+{
+	quat q = rotation;
+
+	return getQuatSunVector(q * getSunQuat(vector) * q.conjugate());
+}
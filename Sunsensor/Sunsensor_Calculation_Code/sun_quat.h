@@ -0,0 +1,13 @@
+#ifndef SUN_QUAT_H
+#define SUN_QUAT_H
+
+#include "sun_vector.h"
+#include "quaternion.h"
+
+Quaternion::quat getSunQuat(const sun_vector_t &vector);
+
+sun_vector_t getQuatSunVector(const Quaternion::quat &q);
+
+sun_vector_t rotateSunVector(const Quaternion::quat &rotation, const sun_vector_t &vector);
+
+#endif
@@ -0,0 +1,138 @@
+#include "sun_vector.h"
+#include "interpolate.h"
+
+/*
+Turns servo and platform angles into a unit direction. The lamp is fixed and the head is
+turned by the servo, about x, on top of the platform, about y, so in the head frame the
+lamp is turned back by the platform first and then by the servo. That puts the platform
+angle along x undiminished and the servo angle along y within the plane the platform left,
+(sin plat, cos plat sin servo, cos plat cos servo), rather than the (tan, tan, 1) of two
+independent axes, which is 3.4 degrees off at 30, 30.
+@param angle - the servo angle as alpha and the platform angle as beta, in degrees
+@param vector - receives the unit vector
+*/
+void getAngleVector(const anglef_t *angle, sun_vector_t *vector) {
+	double servo = angle->alpha * M_PI / 180;
+	double plat = angle->beta * M_PI / 180;
+
+	vector->x = sin(plat);
+	vector->y = cos(plat) * sin(servo);
+	vector->z = cos(plat) * cos(servo);
+}
+
+/*
+Works out the direction of every row of a table
+@param vectors - the vector table to fill
+@param table - the lookup table
+@return - 0 on success, -1 if out of memory
+*/
+int initVectorTable(vector_table_t *vectors, const lookup_table_t *table) {
+	sun_vector_t vector;
+	anglef_t angle;
+	size_t i;
+
+	// Never ask for zero bytes so an empty table still gets a valid block
+	vectors->x = malloc((3 * table->count + 1) * sizeof(float));
+	if (vectors->x == NULL)
+		return -1;
+	vectors->y = vectors->x + table->count;
+	vectors->z = vectors->y + table->count;
+	vectors->count = table->count;
+	for (i = 0; i < table->count; i++) {
+		angle.alpha = table->servo[i];
+		angle.beta = table->plat[i];
+		getAngleVector(&angle, &vector);
+		vectors->x[i] = vector.x;
+		vectors->y[i] = vector.y;
+		vectors->z[i] = vector.z;
+	}
+	return 0;
+}
+
+/*
+Releases the columns of a vector table
+@param vectors - the vector table to release
+*/
+void freeVectorTable(vector_table_t *vectors) {
+	free(vectors->x);
+	vectors->x = vectors->y = vectors->z = NULL;
+	vectors->count = 0;
+}
+
+/*
+Calculates the sun direction in the sensor frame from the best match, interpolated around it
+@param table - the lookup table
+@param vectors - the directions of its rows, or NULL to go through the interpolated angles
+@param realVolts - the voltage readings
+@param vector - receives the unit vector, unchanged if nothing matched
+@return - the deviation of the best match, MAXVOLTDIFF if nothing matched or the reading is dark
+or not finite
+*/
+float getSensorVector(const lookup_table_t *table, const vector_table_t *vectors, const voltage_t *realVolts, sun_vector_t *vector) {
+	voltage_t norm;
+	anglef_t angle;
+	float best;
+	size_t row;
+
+	if (isBadReading(realVolts) || isDark(table, realVolts))
+		return MAXVOLTDIFF;
+	normalizeVoltage(realVolts, &norm);
+	row = findBestMatch(table, &norm, &best);
+	if (row >= table->count)
+		return MAXVOLTDIFF;
+	if (vectors != NULL) {
+		interpolateVector(table, vectors, &norm, row, vector);
+	}
+	else {
+		interpolateAngles(table, &norm, row, &angle);
+		getAngleVector(&angle, vector);
+	}
+	return best;
+}
+
+/*
+Blends the directions of the grid cells around a match with the weights interpolateAngles
+uses, then normalizes the sum
+@param table - the lookup table
+@param vectors - the directions of its rows
+@param norm - the normalized voltage reading
+@param bestRow - the row that matched best
+@param vector - receives the unit vector
+@return - the sum of the weights, larger when the neighbourhood matches more closely
+*/
+float interpolateVector(const lookup_table_t *table, const vector_table_t *vectors, const voltage_t *norm, size_t bestRow, sun_vector_t *vector) {
+	float weight;
+	float total = 0;
+	float x = 0;
+	float y = 0;
+	float z = 0;
+	float current;
+	double length;
+	int servo;
+	int plat;
+	int row;
+
+	for (plat = table->plat[bestRow] - INTERPRADIUS; plat <= table->plat[bestRow] + INTERPRADIUS; plat++) {
+		for (servo = table->servo[bestRow] - INTERPRADIUS; servo <= table->servo[bestRow] + INTERPRADIUS; servo++) {
+			row = getGridRow(table, servo, plat);
+			if (row < 0)
+				continue;
+			current =
+				fabsf(table->volt1[row] - norm->volt1) +
+				fabsf(table->volt2[row] - norm->volt2) +
+				fabsf(table->volt3[row] - norm->volt3) +
+				fabsf(table->volt4[row] - norm->volt4) + INTERPEPSILON;
+			weight = 1 / (current * current);
+			total += weight;
+			x += weight * vectors->x[row];
+			y += weight * vectors->y[row];
+			z += weight * vectors->z[row];
+		}
+	}
+	// Unit vectors within a few degrees of each other never sum to near zero
+	length = sqrt((double)x * x + (double)y * y + (double)z * z);
+	vector->x = x / length;
+	vector->y = y / length;
+	vector->z = z / length;
+	return total;
+}
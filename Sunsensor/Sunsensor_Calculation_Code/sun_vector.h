@@ -0,0 +1,47 @@
+#ifndef SUN_VECTOR_H
+#define SUN_VECTOR_H
+
+#include "calculations.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Most the direction blended from row vectors is found to differ from the direction of the
+// blended angles, in degrees
+#define VECTORTOLERANCE 0.05
+
+// A unit direction towards the sun. In a head frame z points out of the face, x towards
+// positive platform angles, the side of voltage1 and voltage2, and y towards positive servo
+// angles, the side of voltage1 and voltage4. On the rig the servo turns the head about x and
+// is itself carried by the platform, which turns about y.
+typedef struct sun_vector_s {
+	double x;
+	double y;
+	double z;
+} sun_vector_t;
+
+// The direction of every row of a table worked out once, so queries need no trig. Row i
+// of the table points along x[i], y[i], z[i]; the three columns share one block.
+typedef struct vector_table_s {
+	float *x;
+	float *y;
+	float *z;
+	size_t count;
+} vector_table_t;
+
+void getAngleVector(const anglef_t *angle, sun_vector_t *vector);
+
+int initVectorTable(vector_table_t *vectors, const lookup_table_t *table);
+
+void freeVectorTable(vector_table_t *vectors);
+
+float getSensorVector(const lookup_table_t *table, const vector_table_t *vectors, const voltage_t *realVolts, sun_vector_t *vector);
+
+float interpolateVector(const lookup_table_t *table, const vector_table_t *vectors, const voltage_t *norm, size_t bestRow, sun_vector_t *vector);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,309 @@
+#include "table_file.h"
+#include "kdtree.h"
+#include "parse_csv.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define FNVOFFSET 2166136261u
+#define FNVPRIME 16777619u
+
+_Static_assert(sizeof(table_header_t) == 64, "table header must keep the columns aligned");
+_Static_assert(sizeof(int) == sizeof(int32_t), "table columns are stored as int32");
+
+/*
+Reads a lookup table file into memory so it can be queried without any file I/O
+@param table - the table to fill, should be released with freeLookupTable
+@param filename - path of the lookup table text file
+@return - 0 on success, -1 if the file could not be read
+*/
+int initLookupTable(lookup_table_t *table, const char *filename) {
+	sweep_row_t *rows;
+	voltage_t norm;
+	size_t count;
+	size_t i;
+
+	memset(table, 0, sizeof(lookup_table_t));
+	if (parseSweepFile(filename, &rows, &count, 0) != 0)
+		return -1;
+	if (allocLookupTable(table, count) != 0) {
+		free(rows);
+		return -1;
+	}
+	for (i = 0; i < count; i++) {
+		normalizeVoltage(&rows[i].volts, &norm);
+		table->servo[i] = rows[i].servo;
+		table->plat[i] = rows[i].plat;
+		table->volt1[i] = norm.volt1;
+		table->volt2[i] = norm.volt2;
+		table->volt3[i] = norm.volt3;
+		table->volt4[i] = norm.volt4;
+	}
+	free(rows);
+	return indexLookupTable(table);
+}
+
+/*
+Loads a table from either kind of file, mapping a compiled .bin file and parsing text
+otherwise
+@param table - the table to fill, should be released with freeLookupTable
+@param filename - path of the table
+@return - 0 on success, -1 if the file could not be read
+*/
+int loadLookupTable(lookup_table_t *table, const char *filename) {
+	size_t length = strlen(filename);
+
+	if (length > 4 && strcmp(filename + length - 4, ".bin") == 0)
+		return mapLookupTable(table, filename);
+	return initLookupTable(table, filename);
+}
+
+/*
+Writes a loaded table out in the compiled binary format
+@param table - a table loaded with initLookupTable
+@param filename - path of the file to write
+@return - 0 on success, -1 if the file could not be written
+*/
+int writeTableFile(const lookup_table_t *table, const char *filename) {
+	table_header_t header;
+	size_t size = getColumnsSize(table->padded);
+	size_t treeSize = getKdTreeSize(table->count);
+	uint32_t checksum = getTableChecksum(table->servo, size);
+	FILE *fp;
+	int ok;
+
+	// Carry the hash on from the columns into the tree so one checksum covers both
+	checksum = updateTableChecksum(checksum, table->index->points, treeSize);
+	memset(&header, 0, sizeof(header));
+	header.magic = TABLEMAGIC;
+	header.version = TABLEVERSION;
+	header.headerSize = sizeof(header);
+	header.checksum = checksum;
+	header.count = table->count;
+	header.padded = table->padded;
+	header.servoMin = table->servoMin;
+	header.platMin = table->platMin;
+	header.servoCount = table->servoCount;
+	header.platCount = table->platCount;
+	header.treeSize = treeSize;
+
+	fp = fopen(filename, "wb");
+	if (fp == NULL)
+		return -1;
+	// The columns are contiguous from servo onwards, see setTableColumns, and the tree
+	// arrays from points onwards, see setKdTreeArrays
+	ok = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(table->servo, 1, size, fp) == size &&
+		fwrite(table->index->points, 1, treeSize, fp) == treeSize;
+	if (fclose(fp) != 0 || !ok)
+		return -1;
+	return 0;
+}
+
+/*
+Writes a loaded table out in the lookup.txt format, one servo,plat,v1,v2,v3,v4, line per
+row with a blank line after each, so initLookupTable reads it back
+@param table - a loaded table, its voltages are written normalized
+@param filename - path of the file to write
+@return - 0 on success, -1 if the file could not be written
+*/
+int writeTableText(const lookup_table_t *table, const char *filename) {
+	FILE *fp = fopen(filename, "w");
+	size_t i;
+	int ok = 1;
+
+	if (fp == NULL)
+		return -1;
+	for (i = 0; i < table->count && ok; i++) {
+		ok = fprintf(fp, "%d,%d,%.4f,%.4f,%.4f,%.4f,\n\n", table->servo[i], table->plat[i],
+			table->volt1[i], table->volt2[i], table->volt3[i], table->volt4[i]) > 0;
+	}
+	if (fclose(fp) != 0 || !ok)
+		return -1;
+	return 0;
+}
+
+/*
+Gives the text to put before an array element in a generated header
+@param i - the index of the element
+@param perLine - how many elements go on one line
+@return - the separator, starting a new line every perLine elements
+*/
+static const char *getSeparator(size_t i, size_t perLine) {
+	if (i == 0)
+		return "\n\t\t";
+	return i % perLine ? ", " : ",\n\t\t";
+}
+
+/*
+Writes a loaded table out as a C header holding the columns and k-d tree as one const
+struct, so a build can link the table into read-only memory and never open a file
+@param table - a table loaded with initLookupTable
+@param filename - path of the header to write
+@param source - name of the text table it came from, for the header comment
+@return - 0 on success, -1 if the file could not be written
+*/
+int writeTableSource(const lookup_table_t *table, const char *filename, const char *source) {
+	const kdtree_t *tree = table->index;
+	size_t rowCount = (table->count * sizeof(unsigned int) + TABLEALIGN - 1) / TABLEALIGN * TABLEALIGN / sizeof(unsigned int);
+	size_t axisCount = (table->count + TABLEALIGN - 1) / TABLEALIGN * TABLEALIGN;
+	const float *volts[4] = { table->volt1, table->volt2, table->volt3, table->volt4 };
+	FILE *fp;
+	size_t i;
+	int v;
+
+	fp = fopen(filename, "w");
+	if (fp == NULL)
+		return -1;
+	fprintf(fp, "/* Generated by compile_table from %s, do not edit */\n", source);
+	fprintf(fp, "#ifndef LOOKUP_DATA_H\n#define LOOKUP_DATA_H\n\n");
+	fprintf(fp, "#define STATICCOUNT %zu\n#define STATICPADDED %zu\n", table->count, table->padded);
+	fprintf(fp, "#define STATICSIZE %zu\n\n", getColumnsSize(table->padded) + getKdTreeSize(table->count));
+	fprintf(fp, "static const struct {\n");
+	fprintf(fp, "\tint servo[%zu];\n\tint plat[%zu];\n", table->padded, table->padded);
+	for (v = 0; v < 4; v++)
+		fprintf(fp, "\tfloat volt%d[%zu];\n", v + 1, table->padded);
+	fprintf(fp, "\tfloat points[%zu][4];\n\tunsigned int rows[%zu];\n\tunsigned char axis[%zu];\n", table->count, rowCount, axisCount);
+	fprintf(fp, "} staticTable __attribute__((aligned(%d))) = {\n", TABLEALIGN);
+
+	fprintf(fp, "\t{");
+	for (i = 0; i < table->padded; i++)
+		fprintf(fp, "%s%d", getSeparator(i, 16), table->servo[i]);
+	fprintf(fp, "\n\t},\n\t{");
+	for (i = 0; i < table->padded; i++)
+		fprintf(fp, "%s%d", getSeparator(i, 16), table->plat[i]);
+	fprintf(fp, "\n\t},\n");
+	// Nine significant digits give back exactly the same float
+	for (v = 0; v < 4; v++) {
+		fprintf(fp, "\t{");
+		for (i = 0; i < table->padded; i++)
+			fprintf(fp, "%s%.9gf", getSeparator(i, 8), volts[v][i]);
+		fprintf(fp, "\n\t},\n");
+	}
+	fprintf(fp, "\t{");
+	for (i = 0; i < table->count; i++)
+		fprintf(fp, "%s{ %.9gf, %.9gf, %.9gf, %.9gf }", getSeparator(i, 2),
+			tree->points[i][0], tree->points[i][1], tree->points[i][2], tree->points[i][3]);
+	fprintf(fp, "\n\t},\n\t{");
+	for (i = 0; i < table->count; i++)
+		fprintf(fp, "%s%u", getSeparator(i, 16), tree->rows[i]);
+	fprintf(fp, "\n\t},\n\t{");
+	for (i = 0; i < table->count; i++)
+		fprintf(fp, "%s%u", getSeparator(i, 16), tree->axis[i]);
+	fprintf(fp, "\n\t}\n};\n\n#endif\n");
+	if (fclose(fp) != 0)
+		return -1;
+	return 0;
+}
+
+/*
+Writes a quantized table out as a C header of const rows, for linking into flash
+@param quant - the quantized table
+@param filename - path of the header to write
+@param source - name of the text table it came from, for the header comment
+@return - 0 on success, -1 if the file could not be written
+*/
+int writeQuantSource(const quant_table_t *quant, const char *filename, const char *source) {
+	const quant_row_t *row;
+	FILE *fp;
+	size_t i;
+
+	fp = fopen(filename, "w");
+	if (fp == NULL)
+		return -1;
+	fprintf(fp, "/* Generated by compile_table -q from %s, do not edit */\n", source);
+	fprintf(fp, "#ifndef LOOKUP_QDATA_H\n#define LOOKUP_QDATA_H\n\n");
+	fprintf(fp, "#define STATICQCOUNT %zu\n", quant->count);
+	fprintf(fp, "#define STATICQSERVOMIN %d\n#define STATICQPLATMIN %d\n", quant->servoMin, quant->platMin);
+	fprintf(fp, "#define STATICQSERVOCOUNT %d\n#define STATICQPLATCOUNT %d\n\n", quant->servoCount, quant->platCount);
+	fprintf(fp, "static const quant_row_t staticQuantRows[%zu] = {", quant->count + (quant->count == 0));
+	for (i = 0; i < quant->count; i++) {
+		row = &quant->rows[i];
+		fprintf(fp, "%s\t{ %d, %d, { %u, %u, %u, %u } }", i ? ",\n" : "\n", row->servo, row->plat,
+			row->volt[0], row->volt[1], row->volt[2], row->volt[3]);
+	}
+	fprintf(fp, "\n};\n\n#endif\n");
+	if (fclose(fp) != 0)
+		return -1;
+	return 0;
+}
+
+/*
+Maps a compiled table file into memory and uses its columns in place, without parsing
+@param table - the table to fill, should be released with freeLookupTable
+@param filename - path of the compiled table file
+@return - 0 on success, -1 if the file is missing, the wrong version or corrupt
+*/
+int mapLookupTable(lookup_table_t *table, const char *filename) {
+	const table_header_t *header;
+	const char *columns;
+	size_t size;
+	struct stat info;
+	void *map;
+	int fd;
+
+	memset(table, 0, sizeof(lookup_table_t));
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(table_header_t)) {
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+	table->storage = map;
+	table->storageSize = info.st_size;
+	table->storageKind = TABLE_MAPPED;
+
+	header = map;
+	columns = (const char *)map + sizeof(table_header_t);
+	size = getColumnsSize(header->padded);
+	if (header->magic != TABLEMAGIC || header->version != TABLEVERSION ||
+			header->headerSize != sizeof(table_header_t) || header->padded % TABLEPAD != 0 ||
+			header->count > header->padded || header->treeSize != getKdTreeSize(header->count) ||
+			sizeof(table_header_t) + size + header->treeSize != (size_t)info.st_size ||
+			getTableChecksum(columns, size + header->treeSize) != header->checksum) {
+		freeLookupTable(table);
+		return -1;
+	}
+	table->count = header->count;
+	table->padded = header->padded;
+	setTableColumns(table, (void *)columns);
+	table->index = viewKdTree((void *)(columns + size), table->count);
+	if (table->index == NULL) {
+		freeLookupTable(table);
+		return -1;
+	}
+	return indexLookupTable(table);
+}
+
+/*
+Calculates the FNV-1a hash used as the table file checksum
+@param data - the bytes to hash
+@param length - the number of bytes
+@return - the 32 bit hash
+*/
+uint32_t getTableChecksum(const void *data, size_t length) {
+	return updateTableChecksum(FNVOFFSET, data, length);
+}
+
+/*
+Continues an FNV-1a hash over more bytes
+@param hash - the hash of the bytes before these
+@param data - the bytes to hash
+@param length - the number of bytes
+@return - the 32 bit hash
+*/
+uint32_t updateTableChecksum(uint32_t hash, const void *data, size_t length) {
+	const unsigned char *bytes = data;
+	size_t i;
+
+	for (i = 0; i < length; i++) {
+		hash ^= bytes[i];
+		hash *= FNVPRIME;
+	}
+	return hash;
+}
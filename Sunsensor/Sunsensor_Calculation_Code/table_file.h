@@ -0,0 +1,50 @@
+#ifndef TABLE_FILE_H
+#define TABLE_FILE_H
+
+#include <stdint.h>
+#include "calculations.h"
+#include "quant_table.h"
+
+#define TABLEFILE "lookup.bin"
+// "SSLT" read as a little endian word, a file written on the other endianness won't match
+#define TABLEMAGIC 0x544c5353u
+#define TABLEVERSION 1
+
+// Header at the start of a compiled table file. The columns follow straight after it,
+// laid out as in memory: servo, plat (int32) then volt1..volt4 (normalized float), each
+// padded rows long. The k-d tree arrays come last, treeSize bytes, so mapping the file
+// needs no index build either. The checksum covers everything after the header.
+typedef struct table_header_s {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t checksum;
+	uint32_t count;
+	uint32_t padded;
+	int32_t servoMin;
+	int32_t platMin;
+	int32_t servoCount;
+	int32_t platCount;
+	uint32_t treeSize;
+	uint32_t reserved[5];
+} table_header_t;
+
+int initLookupTable(lookup_table_t *table, const char *filename);
+
+int loadLookupTable(lookup_table_t *table, const char *filename);
+
+int writeTableFile(const lookup_table_t *table, const char *filename);
+
+int writeTableText(const lookup_table_t *table, const char *filename);
+
+int writeTableSource(const lookup_table_t *table, const char *filename, const char *source);
+
+int writeQuantSource(const quant_table_t *quant, const char *filename, const char *source);
+
+int mapLookupTable(lookup_table_t *table, const char *filename);
+
+uint32_t getTableChecksum(const void *data, size_t length);
+
+uint32_t updateTableChecksum(uint32_t hash, const void *data, size_t length);
+
+#endif
@@ -1,14 +1,809 @@
-#define _GNU_SOURCE
-#include "calculations.c"
+#include "calculations.h"
+#include "scan.h"
+#include "kdtree.h"
+#include "interpolate.h"
+#include "batch.h"
+#include "photomodel.h"
+#include "table_file.h"
+#include "static_table.h"
+#include "parse_csv.h"
+#include "quant_table.h"
+#include "sun_vector.h"
+#include "sun_heads.h"
+#include "analytic.h"
+#include "tracker.h"
+#include <string.h>
+#include <locale.h>
+
+#define CHECKTABLE "lookup_old.txt"
+
+/*
+Checks that the SIMD scan and the k-d tree pick the same row as the scalar scan for every row
+of another table, both as recorded and with each reading nudged off the grid
+@param table - the lookup table to search
+@param queries - a second table whose rows are used as readings
+@return - the number of queries where the two scans disagree
+*/
+int checkScan(const lookup_table_t *table, const lookup_table_t *queries) {
+	voltage_t norm;
+	float fastDev;
+	float treeDev;
+	float slowDev;
+	size_t slowRow;
+	size_t i;
+	int mismatches = 0;
+
+	for (i = 0; i < 2 * queries->count; i++) {
+		getTableVoltage(queries, i % queries->count, &norm);
+		if (i >= queries->count) {
+			norm.volt1 += 0.013f * (i % 7);
+			norm.volt3 += 0.007f * (i % 5);
+			normalizeVoltage(&norm, &norm);
+		}
+		slowRow = findBestRowScalar(table, &norm, &slowDev);
+		if (findBestRow(table, &norm, &fastDev) != slowRow || fastDev != slowDev)
+			mismatches++;
+		if (kdFindBestRow(table->index, &norm, &treeDev) != slowRow || treeDev != slowDev)
+			mismatches++;
+	}
+	return mismatches;
+}
+
+/*
+Checks the CSV parser against sscanf and strtof: every line of a table file, the file split
+over several threads, every decimal with up to five digits, a million random decimals of up to
+fifteen digits compared bit for bit and a few awkward lines. Numbers that need strtof are
+read again under a locale with a decimal comma, where one is installed.
+@param filename - a table file to parse
+@return - the number of values or lines parsed differently
+*/
+int checkParse(const char *filename) {
+	static const char *awkward = "servo,plat,v1,v2,v3,v4\r\n\n 3, -4 ,0.5,1e-1,2,.25\r\n-0,7,1.,0.0625,3.5,4";
+	static const char *slow = "0,0,1.00000661611557,1e-1,2.5e3,1\n";
+	static const char *commaLocales[] = { "de_DE.UTF-8", "fr_FR.UTF-8", "de_DE", "fr_FR" };
+	const char *cursor = awkward;
+	const char *end = awkward + strlen(awkward);
+	sweep_row_t *rows;
+	sweep_row_t *split;
+	sweep_row_t row;
+	size_t count;
+	size_t splitCount;
+	char line[64];
+	FILE *fp;
+	float expected;
+	size_t i = 0;
+	int mismatches = 0;
+	unsigned long long seed = 1;
+	int value;
+	int digits;
+
+	if (parseSweepFile(filename, &rows, &count, 1) != 0)
+		return 1;
+	fp = fopen(filename, "r");
+	while (fp != NULL && fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "%d,%d,%f,%f,%f,%f", &row.servo, &row.plat, &row.volts.volt1, &row.volts.volt2, &row.volts.volt3, &row.volts.volt4) != 6)
+			continue;
+		if (i >= count || memcmp(&row, &rows[i], sizeof(row)) != 0)
+			mismatches++;
+		i++;
+	}
+	if (fp == NULL || i != count)
+		mismatches++;
+	if (fp != NULL)
+		fclose(fp);
+	if (parseSweepFile(filename, &split, &splitCount, 4) != 0 || splitCount != count || memcmp(split, rows, count * sizeof(sweep_row_t)) != 0)
+		mismatches++;
+	free(rows);
+	free(split);
+
+	for (value = 0; value < 100000; value++) {
+		for (digits = 0; digits <= 5; digits++) {
+			snprintf(line, sizeof(line), "0,0,%d.%0*d,1,1,1\n", value / 100000, digits, value % 100000 / (int)pow(10, 5 - digits));
+			cursor = line;
+			expected = strtof(line + 4, NULL);
+			if (parseSweepRow(&cursor, line + strlen(line), &row) != CSV_ROW || row.volts.volt1 != expected)
+				mismatches++;
+		}
+	}
+
+	// Long numbers bit for bit, ending with two whose double lands exactly half way between
+	// two floats, where rounding twice goes the wrong way
+	for (value = 0; value < 1000002; value++) {
+		if (value == 1000000)
+			snprintf(line, sizeof(line), "0,0,1.00000661611557,1,1,1\n");
+		else if (value == 1000001)
+			snprintf(line, sizeof(line), "0,0,1.00001460313797,1,1,1\n");
+		else {
+			seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+			digits = 12 - value % 12;
+			snprintf(line, sizeof(line), "0,0,%lld.%0*lld,1,1,1\n", (long long)(seed >> 54), digits, (long long)(seed >> 16) % (long long)pow(10, digits));
+		}
+		cursor = line;
+		expected = strtof(line + 4, NULL);
+		if (parseSweepRow(&cursor, line + strlen(line), &row) != CSV_ROW || memcmp(&row.volts.volt1, &expected, sizeof(float)) != 0)
+			mismatches++;
+	}
+
+	cursor = awkward;
+	if (parseSweepRow(&cursor, end, &row) != CSV_MALFORMED)
+		mismatches++;
+	if (parseSweepRow(&cursor, end, &row) != CSV_ROW || row.servo != 3 || row.plat != -4 || row.volts.volt2 != 0.1f || row.volts.volt4 != 0.25f)
+		mismatches++;
+	if (parseSweepRow(&cursor, end, &row) != CSV_ROW || row.servo != 0 || row.plat != 7 || row.volts.volt1 != 1 || row.volts.volt4 != 4)
+		mismatches++;
+	if (parseSweepRow(&cursor, end, &row) != CSV_END)
+		mismatches++;
+
+	expected = strtof("1.00000661611557", NULL);
+	for (i = 0; i < sizeof(commaLocales) / sizeof(commaLocales[0]) && setlocale(LC_NUMERIC, commaLocales[i]) == NULL; i++)
+		;
+	if (i < sizeof(commaLocales) / sizeof(commaLocales[0])) {
+		cursor = slow;
+		if (parseSweepRow(&cursor, slow + strlen(slow), &row) != CSV_ROW || row.volts.volt1 != expected || row.volts.volt2 != 0.1f || row.volts.volt3 != 2500)
+			mismatches++;
+		setlocale(LC_NUMERIC, "C");
+	}
+	return mismatches;
+}
+
+/*
+Checks the match limits: dim readings must come back dark, readings that are not finite
+must match nothing, and a search allowed to stop early must return either the best row or
+one under the good enough limit
+@param table - the lookup table, its limits are put back to the defaults afterwards
+@param queries - a second table whose rows are used as readings
+@return - the number of readings handled wrongly
+*/
+int checkLimits(lookup_table_t *table, const lookup_table_t *queries) {
+	const float goodEnough = 0.05f;
+	voltage_t dark = { 0, 0, 0, 0 };
+	voltage_t dim = { 0.1f, 0.1f, 0.1f, 0.1f };
+	const voltage_t bad[] = { { INFINITY, 0.2f, 0.3f, 0.1f }, { NAN, 0.2f, 0.3f, 0.1f }, { 0.2f, INFINITY, -INFINITY, 0.1f }, { 0.2f, 0.3f, 0.1f, -INFINITY } };
+	voltage_t norm;
+	voltage_t match;
+	angle_t angle;
+	anglef_t fineAngle;
+	sun_match_t second;
+	match_rows_t kept;
+	tracker_t tracker;
+	float exactDev;
+	float treeDev;
+	float scanDev;
+	size_t row;
+	size_t i;
+	int mismatches = 0;
+
+	if (getAngles(table, &dark, &angle) != SUN_DARK || getAngles(table, &dim, &angle) != SUN_OK)
+		mismatches++;
+	setMatchLimits(table, 0.5f, goodEnough);
+	if (getAngles(table, &dim, &angle) != SUN_DARK)
+		mismatches++;
+	initTracker(&tracker, table, TRACKRADIUS, TRACKTHRESHOLD);
+	for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		if (getAngles(table, &bad[i], &angle) != SUN_NOMATCH || getAnglesMatch(table, &bad[i], &second) != SUN_NOMATCH)
+			mismatches++;
+		if (getAnglesInterp(table, &bad[i], &fineAngle) != MAXVOLTDIFF || trackAngles(&tracker, &bad[i], &angle) != MAXVOLTDIFF)
+			mismatches++;
+	}
+	// A first candidate that is not a number, or only ties the bound, is not kept
+	kept.found = 0;
+	kept.bound = MAXVOLTDIFF;
+	keepMatchRow(table, &kept, 0, NAN);
+	keepMatchRow(table, &kept, 1, MAXVOLTDIFF);
+	if (kept.found != 0)
+		mismatches++;
+	for (i = 0; i < queries->count; i++) {
+		getTableVoltage(queries, i, &norm);
+		findBestRowScalar(table, &norm, &exactDev);
+		row = findBestMatch(table, &norm, &treeDev);
+		getTableVoltage(table, row, &match);
+		if (getNormDeviation(&norm, &match) != treeDev || (treeDev != exactDev && !(treeDev < goodEnough)))
+			mismatches++;
+		row = findGoodRow(table, &norm, goodEnough, &scanDev);
+		getTableVoltage(table, row, &match);
+		if (getNormDeviation(&norm, &match) != scanDev || (scanDev != exactDev && !(scanDev < goodEnough)))
+			mismatches++;
+	}
+	setMatchLimits(table, DARKSUM, GOODENOUGH);
+	return mismatches;
+}
+
+/*
+Checks the second match against a brute force search: the tree and the scan must give the
+same matches, the best must be the one getAngles gives and the second must be the best row
+outside ALIASRADIUS of it
+@param table - the lookup table
+@param queries - a second table whose rows are used as readings
+@return - the number of readings matched wrongly
+*/
+int checkMatch(const lookup_table_t *table, const lookup_table_t *queries) {
+	match_rows_t kept;
+	sun_match_t match;
+	sun_match_t scanMatch;
+	voltage_t norm;
+	voltage_t look;
+	angle_t angle;
+	float secondDev;
+	float current;
+	size_t i;
+	size_t j;
+	int mismatches = 0;
+
+	for (i = 0; i < queries->count; i++) {
+		getTableVoltage(queries, i, &norm);
+		// Table rows are already normalized, so they can be given as readings directly
+		if (getAnglesMatch(table, &norm, &match) != SUN_OK || getAngles(table, &norm, &angle) != SUN_OK || match.best.alpha != angle.alpha || match.best.beta != angle.beta) {
+			mismatches++;
+			continue;
+		}
+		// getAnglesMatch normalizes the reading again, so compare against the same rounding
+		normalizeVoltage(&norm, &norm);
+		findMatchRowsScalar(table, &norm, &kept);
+		if (getMatchRows(table, &kept, &scanMatch) != SUN_OK || memcmp(&match, &scanMatch, sizeof(sun_match_t)) != 0) {
+			mismatches++;
+			continue;
+		}
+		secondDev = MAXVOLTDIFF;
+		for (j = 0; j < table->count; j++) {
+			if (abs(table->servo[j] - angle.alpha) <= ALIASRADIUS && abs(table->plat[j] - angle.beta) <= ALIASRADIUS)
+				continue;
+			getTableVoltage(table, j, &look);
+			current = getNormDeviation(&norm, &look);
+			if (current < secondDev)
+				secondDev = current;
+		}
+		if (match.secondDev != secondDev || (abs(match.second.alpha - angle.alpha) <= ALIASRADIUS && abs(match.second.beta - angle.beta) <= ALIASRADIUS))
+			mismatches++;
+	}
+	return mismatches;
+}
+
+/*
+Checks the sensor frame sun vector: from the row directions it must agree with the vector of
+the interpolated angles to within VECTORTOLERANCE, and it must be a unit vector
+@param table - the lookup table
+@param queries - a table whose rows are used as readings
+@param worstAngle - receives the largest angle between the two vectors, in degrees
+@return - the number of readings handled wrongly, or 1 if the vector table could not be built
+*/
+int checkVectors(const lookup_table_t *table, const lookup_table_t *queries, double *worstAngle) {
+	vector_table_t vectors;
+	sun_vector_t fast;
+	sun_vector_t slow;
+	voltage_t realVolts;
+	double angle;
+	size_t i;
+	int mismatches = 0;
+
+	*worstAngle = 0;
+	if (initVectorTable(&vectors, table) != 0)
+		return 1;
+	for (i = 0; i < queries->count; i++) {
+		getTableVoltage(queries, i, &realVolts);
+		if (getSensorVector(table, &vectors, &realVolts, &fast) != getSensorVector(table, NULL, &realVolts, &slow)) {
+			mismatches++;
+			continue;
+		}
+		angle = acos(fmin(1, fast.x * slow.x + fast.y * slow.y + fast.z * slow.z)) * 180 / M_PI;
+		if (angle > *worstAngle)
+			*worstAngle = angle;
+		if (angle > VECTORTOLERANCE || fabs(fast.x * fast.x + fast.y * fast.y + fast.z * fast.z - 1) > 1e-12)
+			mismatches++;
+	}
+	freeVectorTable(&vectors);
+	return mismatches;
+}
+
+/*
+Checks the sun vector of two heads, one on +z over the built in table and one on +x mapped
+from the compiled one: with one head lit the vector must be that head's direction
+turned to its face, a lit head matching too poorly must give no match rather than dark,
+with neither lit there must be no vector, and a face that does not exist must have no
+rotation
+@param queries - a table whose rows are used as readings
+@return - the number of readings handled wrongly, or 1 if the heads could not be loaded
+*/
+int checkHeads(const lookup_table_t *queries) {
+	sun_heads_t heads;
+	lookup_table_t table;
+	double rotation[3][3];
+	sun_vector_t sun;
+	sun_vector_t head;
+	voltage_t realVolts[2];
+	voltage_t dark = { 0, 0, 0, 0 };
+	float devs[2];
+	float dev;
+	size_t i;
+	int lit;
+	int status;
+	int mismatches = 0;
+
+	initSunHeads(&heads);
+	getFaceRotation(FACE_PZ, rotation);
+	if (initStaticTable(&table) != 0)
+		return 1;
+	if (addSunHead(&heads, &table, rotation) != 0) {
+		freeLookupTable(&table);
+		return 1;
+	}
+	getFaceRotation(FACE_PX, rotation);
+	if (loadLookupTable(&table, TABLEFILE) != 0) {
+		freeSunHeads(&heads);
+		return 1;
+	}
+	if (addSunHead(&heads, &table, rotation) != 1) {
+		freeLookupTable(&table);
+		freeSunHeads(&heads);
+		return 1;
+	}
+	for (i = 0; i < queries->count; i++) {
+		getTableVoltage(queries, i, &realVolts[0]);
+		dev = getSensorVector(&heads.heads[0].table, &heads.heads[0].vectors, &realVolts[0], &head);
+		for (lit = 0; lit < 2; lit++) {
+			realVolts[lit] = realVolts[0];
+			realVolts[1 - lit] = dark;
+			status = getSunVector(&heads, realVolts, &sun, devs);
+			if (!(dev <= HEADMAXDEV)) {
+				if (status != SUN_NOMATCH)
+					mismatches++;
+				continue;
+			}
+			// The +x head sees the body x axis as its z and the body z axis as its -x
+			if (status != SUN_OK || devs[lit] != dev || devs[1 - lit] != MAXVOLTDIFF ||
+				fabs(sun.x - (lit ? head.z : head.x)) > 1e-9 || fabs(sun.y - head.y) > 1e-9 || fabs(sun.z - (lit ? -head.x : head.z)) > 1e-9)
+				mismatches++;
+		}
+	}
+	realVolts[0] = realVolts[1] = dark;
+	if (getSunVector(&heads, realVolts, &sun, NULL) != SUN_DARK)
+		mismatches++;
+	// A face out of range is refused and leaves the last rotation alone
+	if (getFaceRotation(FACE_PX - 1, rotation) != -1 || getFaceRotation(FACE_NZ + 1, rotation) != -1 || rotation[0][2] != 1)
+		mismatches++;
+	freeSunHeads(&heads);
+	return mismatches;
+}
+
+/*
+Checks the fixed point pipeline against the float one: the integer kernel on the quantized
+table must find a match as good as the float scan to within QTOLERANCE, integer
+normalization must agree with the float one, interpolation must agree to within
+QANGLETOLERANCE and the built in quantized rows must be the same. A row lit only on channel 1
+must not be taken for a hole, and counts up to the table's dark limit must come back dark.
+@param table - the lookup table to search
+@param queries - a second table whose rows are used as readings
+@param sameRows - receives how many readings got the same angles
+@param worstAngle - receives the largest interpolation difference in degrees
+@return - the number of readings outside the tolerances, plus differing rows
+*/
+int checkQuant(const lookup_table_t *table, const lookup_table_t *queries, size_t *sameRows, float *worstAngle) {
+	lookup_table_t lit;
+	quant_table_t quant;
+	quant_table_t linked;
+	voltage_t norm;
+	voltage_t match;
+	voltage_t countVolts;
+	anglef_t floatAngle;
+	anglefx_t fixedAngle;
+	angle_t quantAngle;
+	float angleError;
+	uint16_t ratio[4];
+	uint16_t counts[4];
+	uint16_t countRatio[4];
+	uint16_t floatRatio[4];
+	uint32_t quantDev;
+	float floatDev;
+	size_t floatRow;
+	size_t quantRow;
+	size_t i;
+	int mismatches = 0;
+	int j;
+
+	*sameRows = 0;
+	*worstAngle = 0;
+	if (quantizeTable(&quant, table) != 0)
+		return 1;
+	initStaticQuantTable(&linked);
+	if (linked.count != quant.count || memcmp(linked.rows, quant.rows, quant.count * sizeof(quant_row_t)) != 0)
+		mismatches++;
+	for (i = 0; i < 2 * queries->count; i++) {
+		getTableVoltage(queries, i % queries->count, &norm);
+		if (i >= queries->count) {
+			norm.volt1 += 0.013f * (i % 7);
+			norm.volt3 += 0.007f * (i % 5);
+			normalizeVoltage(&norm, &norm);
+		}
+		floatRow = findBestRowScalar(table, &norm, &floatDev);
+		quantizeVoltage(&norm, ratio);
+		// Raw counts normalized in integers should land within a step of the float ratios
+		counts[0] = norm.volt1 * 1000;
+		counts[1] = norm.volt2 * 1000;
+		counts[2] = norm.volt3 * 1000;
+		counts[3] = norm.volt4 * 1000;
+		countVolts.volt1 = counts[0];
+		countVolts.volt2 = counts[1];
+		countVolts.volt3 = counts[2];
+		countVolts.volt4 = counts[3];
+		normalizeVoltage(&countVolts, &countVolts);
+		quantizeVoltage(&countVolts, floatRatio);
+		quantizeCounts(counts, countRatio);
+		for (j = 0; j < 4; j++) {
+			if (abs((int)countRatio[j] - floatRatio[j]) > 1)
+				mismatches++;
+		}
+		quantRow = findBestQuantRow(&quant, ratio, &quantDev);
+		getTableVoltage(table, getGridRow(table, quant.rows[quantRow].servo, quant.rows[quantRow].plat), &match);
+		if (quant.rows[quantRow].servo == table->servo[floatRow] && quant.rows[quantRow].plat == table->plat[floatRow])
+			(*sameRows)++;
+		else if (getNormDeviation(&norm, &match) > floatDev + QTOLERANCE)
+			mismatches++;
+
+		// Interpolating from the same best cell should agree with the float version
+		interpolateAngles(table, &norm, floatRow, &floatAngle);
+		interpolateAnglesQuant(&quant, ratio, getQuantRow(&quant, table->servo[floatRow], table->plat[floatRow]), &fixedAngle);
+		angleError = fmaxf(fabsf(fixedAngle.alpha / (float)QANGLEONE - floatAngle.alpha), fabsf(fixedAngle.beta / (float)QANGLEONE - floatAngle.beta));
+		if (angleError > *worstAngle)
+			*worstAngle = angleError;
+		if (angleError > QANGLETOLERANCE)
+			mismatches++;
+	}
+	freeQuantTable(&quant);
+
+	// A row with all its light on channel 1 is a real row, the unvisited cell between is not
+	if (allocLookupTable(&lit, 2) != 0)
+		return mismatches + 1;
+	lit.servo[0] = 0;
+	lit.servo[1] = 2;
+	lit.plat[0] = lit.plat[1] = 0;
+	lit.volt1[0] = 1;
+	lit.volt2[0] = lit.volt3[0] = lit.volt4[0] = 0;
+	lit.volt1[1] = lit.volt2[1] = lit.volt3[1] = lit.volt4[1] = 0.25f;
+	if (indexLookupTable(&lit) != 0 || quantizeTable(&quant, &lit) != 0) {
+		freeLookupTable(&lit);
+		return mismatches + 1;
+	}
+	if (quant.rows[0].volt[0] != QHOLE || getQuantRow(&quant, 0, 0) != 0 || getQuantRow(&quant, 1, 0) != -1 || getQuantRow(&quant, 2, 0) != 2)
+		mismatches++;
+	freeQuantTable(&quant);
+
+	// The dark limit carries over from the table: counts summing to it are dark, one more is not
+	setMatchLimits(&lit, 100.5f, GOODENOUGH);
+	if (quantizeTable(&quant, &lit) != 0) {
+		freeLookupTable(&lit);
+		return mismatches + 1;
+	}
+	counts[0] = counts[1] = counts[2] = counts[3] = 25;
+	if (quant.darkSum != 100 || getAnglesQuant(&quant, counts, &quantAngle) != SUN_DARK || getAnglesInterpQuant(&quant, counts, &fixedAngle) != UINT32_MAX)
+		mismatches++;
+	counts[0] = 26;
+	if (getAnglesQuant(&quant, counts, &quantAngle) != SUN_OK || getAnglesInterpQuant(&quant, counts, &fixedAngle) == UINT32_MAX)
+		mismatches++;
+	freeQuantTable(&quant);
+	freeLookupTable(&lit);
+	counts[0] = counts[1] = counts[2] = counts[3] = 0;
+	if (linked.darkSum != 0 || getAnglesQuant(&linked, counts, &quantAngle) != SUN_DARK)
+		mismatches++;
+	return mismatches;
+}
+
+/*
+Checks that a table mapped from the compiled file or linked in at build time matches the
+table parsed from text
+@param table - the table parsed from text
+@param mapped - the same table mapped from its compiled file or linked in
+@return - the number of rows, grid cells or tree nodes that differ
+*/
+int checkSameTable(const lookup_table_t *table, const lookup_table_t *mapped) {
+	int mismatches = 0;
+	size_t i;
+
+	if (mapped->count != table->count || mapped->servoCount != table->servoCount || mapped->platCount != table->platCount)
+		return 1;
+	for (i = 0; i < table->count; i++) {
+		if (mapped->servo[i] != table->servo[i] || mapped->plat[i] != table->plat[i] ||
+				mapped->volt1[i] != table->volt1[i] || mapped->volt2[i] != table->volt2[i] ||
+				mapped->volt3[i] != table->volt3[i] || mapped->volt4[i] != table->volt4[i])
+			mismatches++;
+	}
+	for (i = 0; i < (size_t)table->servoCount * table->platCount; i++) {
+		if (mapped->grid[i] != table->grid[i])
+			mismatches++;
+	}
+	for (i = 0; i < table->count; i++) {
+		if (mapped->index->rows[i] != table->index->rows[i] || mapped->index->axis[i] != table->index->axis[i])
+			mismatches++;
+	}
+	return mismatches;
+}
+
+/*
+Checks that a threaded batch gives the same angles and statuses as matching the readings one
+at a time, and that a dark reading is reported as dark rather than as a match at 0, 0
+@param table - the lookup table to search
+@param queries - a second table whose rows are used as readings
+@return - the number of readings where the two disagree
+*/
+int checkBatch(const lookup_table_t *table, const lookup_table_t *queries) {
+	// One more reading than there are queries, a dark one at the end
+	size_t n = queries->count + 1;
+	voltage_t *readings = malloc(n * sizeof(voltage_t));
+	angle_t *angles = malloc(n * sizeof(angle_t));
+	int *statuses = malloc(n * sizeof(int));
+	angle_t single;
+	int mismatches = 0;
+	int status;
+	size_t i;
+
+	if (readings == NULL || angles == NULL || statuses == NULL) {
+		free(readings);
+		free(angles);
+		free(statuses);
+		return 1;
+	}
+	for (i = 0; i < queries->count; i++)
+		getTableVoltage(queries, i, &readings[i]);
+	memset(&readings[queries->count], 0, sizeof(voltage_t));
+	if (getAnglesBatch(table, readings, n, angles, statuses, 4) != 0)
+		mismatches++;
+	for (i = 0; i < n; i++) {
+		status = getAngles(table, &readings[i], &single);
+		if (status != statuses[i] || (status == SUN_OK && (single.alpha != angles[i].alpha || single.beta != angles[i].beta)))
+			mismatches++;
+	}
+	if (statuses[queries->count] != SUN_DARK)
+		mismatches++;
+	free(readings);
+	free(angles);
+	free(statuses);
+	return mismatches;
+}
+
+/*
+Checks the analytic estimator: fastAtan against atan, the angles of readings made from the
+geometry it assumes, the batch call against single ones and a dark reading. On recorded
+readings the mapped estimate must be within rmsLimit of the full search angles, rms. Maps
+fitted to either table must take the servo mostly from beta and the platform mostly from
+alpha, as the ideal map does; lookup.txt must also agree on their signs, while lookup_old.txt
+was recorded with the platform turning the other way.
+@param table - the lookup table
+@param queries - a table whose rows are used as readings
+@param rmsError - receives how far the mapped estimates are from the full search angles, in degrees
+@return - the number of readings handled wrongly, or 1 if no map could be fitted
+*/
+int checkAnalytic(const lookup_table_t *table, const lookup_table_t *queries, double *rmsError) {
+	// The fitted map comes to 8.0 degrees rms on lookup_old.txt against lookup.txt
+	const double rmsLimit = 10;
+	analytic_t analytic;
+	analytic_t ideal;
+	analytic_t recorded;
+	voltage_t *readings;
+	anglef_t *angles;
+	anglef_t angle;
+	angle_t best;
+	voltage_t volts;
+	voltage_t dark = { 0, 0, 0, 0 };
+	double x;
+	double y;
+	double error = 0;
+	float bestDev;
+	float t;
+	size_t row;
+	size_t i;
+	int alpha;
+	int beta;
+	int mismatches = 0;
+
+	for (t = -20; t <= 20; t += 0.001f) {
+		if (fabsf(fastAtan(t) - atanf(t)) > 1e-5f)
+			mismatches++;
+	}
+	// The window's light moves HEIGHT * tan(angle), fully lighting one half of each axis
+	for (alpha = -40; alpha <= 40; alpha += 5) {
+		for (beta = -40; beta <= 40; beta += 5) {
+			x = SENSORHEIGHT * tan(alpha * M_PI / 180);
+			y = SENSORHEIGHT * tan(beta * M_PI / 180);
+			volts.volt1 = (SENSORWIDTH / 2 - fmax(0, -x)) * (SENSORWIDTH / 2 - fmax(0, -y));
+			volts.volt2 = (SENSORWIDTH / 2 - fmax(0, -x)) * (SENSORWIDTH / 2 - fmax(0, y));
+			volts.volt3 = (SENSORWIDTH / 2 - fmax(0, x)) * (SENSORWIDTH / 2 - fmax(0, y));
+			volts.volt4 = (SENSORWIDTH / 2 - fmax(0, x)) * (SENSORWIDTH / 2 - fmax(0, -y));
+			getAnglesAnalytic(&volts, &angle);
+			if (fabsf(angle.alpha - alpha) > 0.01f || fabsf(angle.beta - beta) > 0.01f)
+				mismatches++;
+		}
+	}
+	getAnglesAnalytic(&dark, &angle);
+	if (angle.alpha != 0 || angle.beta != 0)
+		mismatches++;
+
+	readings = malloc(queries->count * sizeof(voltage_t));
+	angles = malloc(queries->count * sizeof(anglef_t));
+	if (readings == NULL || angles == NULL || fitAnalytic(&analytic, table) != 0) {
+		free(readings);
+		free(angles);
+		return 1;
+	}
+	for (i = 0; i < queries->count; i++)
+		getTableVoltage(queries, i, &readings[i]);
+	getAnglesAnalyticBatch(readings, queries->count, angles);
+	for (i = 0; i < queries->count; i++) {
+		getAnglesAnalytic(&readings[i], &angle);
+		if (memcmp(&angle, &angles[i], sizeof(anglef_t)) != 0)
+			mismatches++;
+		normalizeVoltage(&readings[i], &volts);
+		row = findBestMatch(table, &volts, &bestDev);
+		if (row >= table->count)
+			continue;
+		best.alpha = table->servo[row];
+		best.beta = table->plat[row];
+		mapAnalytic(&analytic, &angle, &angle);
+		error += (angle.alpha - best.alpha) * (angle.alpha - best.alpha) + (angle.beta - best.beta) * (angle.beta - best.beta);
+	}
+	*rmsError = sqrt(error / queries->count);
+	if (!(*rmsError < rmsLimit))
+		mismatches++;
+	free(readings);
+	free(angles);
+
+	initAnalytic(&ideal);
+	if (fitAnalytic(&recorded, queries) != 0)
+		return mismatches + 1;
+	if (!(analytic.servo[1] * ideal.servo[1] > fabsf(analytic.servo[0])) || !(analytic.plat[0] * ideal.plat[0] > fabsf(analytic.plat[1])))
+		mismatches++;
+	if (!(recorded.servo[1] * ideal.servo[1] > fabsf(recorded.servo[0])) || !(fabsf(recorded.plat[0]) > fabsf(recorded.plat[1])))
+		mismatches++;
+	return mismatches;
+}
+
+/*
+Checks that inverting the photodiode model recovers the angles it was evaluated at, with
+and without the table, that a reading is dark for the model exactly when it is dark for
+getAngles under the table's limit, and that light on two opposite quadrants, which no angle
+gives, matches nothing
+@param model - the loaded model
+@param table - the lookup table the model was fitted to
+@return - the number of angles recovered worse than a hundredth of a degree, plus dark and
+impossible readings handled differently
+*/
+int checkModel(const photomodel_t *model, const lookup_table_t *table) {
+	const voltage_t opposite[] = { { 0.5f, 0, 0.5f, 0 }, { 0, 0.5f, 0, 0.5f } };
+	lookup_table_t limited = *table;
+	voltage_t volts;
+	anglef_t angle;
+	angle_t match;
+	float x;
+	float y;
+	size_t i;
+	int mismatches = 0;
+
+	for (x = model->xMin + 0.5f; x < model->xMax; x += 2.5f) {
+		for (y = model->yMin + 0.5f; y < model->yMax; y += 2.5f) {
+			evalPhotoModel(model, x, y, &volts);
+			if (getAnglesModel(model, NULL, &volts, NULL, &angle) != SUN_OK || fabsf(angle.alpha - x) > 0.01f || fabsf(angle.beta - y) > 0.01f)
+				mismatches++;
+			if (getAnglesModel(model, table, &volts, NULL, &angle) != SUN_OK || fabsf(angle.alpha - x) > 0.01f || fabsf(angle.beta - y) > 0.01f)
+				mismatches++;
+		}
+	}
+	// Rows summing to one against a limit just above and just below, on a copy of the table
+	for (i = 0; i < table->count; i += 37) {
+		getTableVoltage(table, i, &volts);
+		setMatchLimits(&limited, 1.01f, GOODENOUGH);
+		if (getAnglesModel(model, &limited, &volts, NULL, &angle) != SUN_DARK || getAngles(&limited, &volts, &match) != SUN_DARK)
+			mismatches++;
+		setMatchLimits(&limited, 0.99f, GOODENOUGH);
+		if (getAnglesModel(model, &limited, &volts, NULL, &angle) != SUN_OK || getAngles(&limited, &volts, &match) != SUN_OK)
+			mismatches++;
+	}
+	for (i = 0; i < sizeof(opposite) / sizeof(opposite[0]); i++) {
+		if (getAnglesModel(model, table, &opposite[i], NULL, &angle) != SUN_NOMATCH)
+			mismatches++;
+	}
+	return mismatches;
+}
 
 int main(void) {
-	angle_t *currentAngle = malloc(sizeof(angle_t));
-	voltage_t *realVolts = malloc(sizeof(voltage_t));
-	realVolts->volt1 = 0.27;
-	realVolts->volt2 = 0.60;
-	realVolts->volt3 = 0.11;
-	realVolts->volt4 = 0.02;
-	currentAngle = getAngles(realVolts);
-	printf("The servo angle is : %d\n", currentAngle->alpha);
-	printf("The platform angle is : %d\n", currentAngle->beta);
-}
\ No newline at end of file
+	lookup_table_t table;
+	lookup_table_t queries;
+	lookup_table_t mapped;
+	photomodel_t model;
+	angle_t currentAngle;
+	anglef_t fineAngle;
+	int mismatches = 0;
+	int failures = 0;
+	size_t sameRows;
+	float worstAngle;
+	double worstVector;
+	double estimateError;
+	voltage_t realVolts;
+	quant_table_t quant;
+	anglefx_t fixedAngle;
+	const uint16_t counts[4] = { 270, 600, 110, 20 };
+	if (initLookupTable(&table, LOOKUPTABLE) != 0) {
+		printf("Could not read %s\n", LOOKUPTABLE);
+		return EXIT_FAILURE;
+	}
+	realVolts.volt1 = 0.27;
+	realVolts.volt2 = 0.60;
+	realVolts.volt3 = 0.11;
+	realVolts.volt4 = 0.02;
+	if (getAngles(&table, &realVolts, &currentAngle) != SUN_OK) {
+		printf("No match for the reading\n");
+		failures++;
+	}
+	printf("The servo angle is : %d\n", currentAngle.alpha);
+	printf("The platform angle is : %d\n", currentAngle.beta);
+	getAnglesInterp(&table, &realVolts, &fineAngle);
+	printf("Interpolated angles : %.2f, %.2f\n", fineAngle.alpha, fineAngle.beta);
+	initStaticQuantTable(&quant);
+	if (getAnglesInterpQuant(&quant, counts, &fixedAngle) == UINT32_MAX) {
+		printf("No fixed point match for the reading\n");
+		failures++;
+	}
+	printf("Fixed point interpolated angles : %.2f, %.2f\n", fixedAngle.alpha / (float)QANGLEONE, fixedAngle.beta / (float)QANGLEONE);
+
+	mismatches = checkParse(CHECKTABLE);
+	printf("Parse mismatches over %s : %d\n", CHECKTABLE, mismatches);
+	failures += mismatches;
+	if (initLookupTable(&queries, CHECKTABLE) == 0) {
+		mismatches = checkScan(&table, &queries);
+		printf("Scan mismatches over %s : %d\n", CHECKTABLE, mismatches);
+		failures += mismatches;
+		mismatches = checkLimits(&table, &queries);
+		printf("Dark, bad reading and early exit mismatches : %d\n", mismatches);
+		failures += mismatches;
+		mismatches = checkMatch(&table, &queries);
+		printf("Second match mismatches : %d\n", mismatches);
+		failures += mismatches;
+		mismatches = checkVectors(&table, &queries, &worstVector);
+		printf("Sun vector mismatches : %d (row directions within %.4f degrees of the angles)\n", mismatches, worstVector);
+		failures += mismatches;
+		mismatches = checkHeads(&queries);
+		printf("Sensor head mismatches : %d\n", mismatches);
+		failures += mismatches;
+		mismatches = checkQuant(&table, &queries, &sameRows, &worstAngle);
+		printf("Fixed point mismatches : %d (same angles for %zu of %zu, interpolation within %.4f degrees)\n", mismatches, sameRows, 2 * queries.count, worstAngle);
+		failures += mismatches;
+		mismatches = checkAnalytic(&table, &queries, &estimateError);
+		printf("Analytic estimate mismatches : %d (estimate %.1f degrees rms from the table)\n", mismatches, estimateError);
+		failures += mismatches;
+		mismatches = checkBatch(&table, &queries);
+		printf("Batch mismatches over %s : %d\n", CHECKTABLE, mismatches);
+		failures += mismatches;
+		freeLookupTable(&queries);
+	}
+	else {
+		printf("Could not read %s\n", CHECKTABLE);
+		failures++;
+	}
+	if (mapLookupTable(&mapped, TABLEFILE) == 0) {
+		mismatches = checkSameTable(&table, &mapped);
+		printf("Mismatches with mapped %s : %d\n", TABLEFILE, mismatches);
+		failures += mismatches;
+		freeLookupTable(&mapped);
+	}
+	else {
+		printf("Could not map %s\n", TABLEFILE);
+		failures++;
+	}
+	if (initStaticTable(&mapped) == 0) {
+		mismatches = checkSameTable(&table, &mapped);
+		printf("Mismatches with the built in table : %d\n", mismatches);
+		failures += mismatches;
+		freeLookupTable(&mapped);
+	}
+	else {
+		printf("Could not set up the built in table\n");
+		failures++;
+	}
+	if (loadPhotoModel(&model, MODELFILE) == 0) {
+		mismatches = checkModel(&model, &table);
+		printf("Model inversion misses : %d\n", mismatches);
+		failures += mismatches;
+	}
+	else {
+		printf("Could not read %s\n", MODELFILE);
+		failures++;
+	}
+	freeLookupTable(&table);
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
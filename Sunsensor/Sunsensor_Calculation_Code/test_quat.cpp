@@ -0,0 +1,107 @@
+#include "sun_quat.h"
+
+using namespace Quaternion;
+
+// Most a component of the rig's direction may differ from getAngleVector's
+#define QUATTOLERANCE 1e-12
+
+static quat getAxisQuat(double x, double y, double z, double degrees);
+static int checkRig(double *worstTan);
+static int checkRotation(void);
+
+/*
+Checks the sun vector code from C++, linked with the quaternion library as attitude code uses it
+*/
+int main(void)
+{
+	double worstTan;
+	int mismatches;
+	int failures = 0;
+
+	mismatches = checkRig(&worstTan);
+	printf("Rig direction mismatches : %d (independent axes up to %.2f degrees off)\n", mismatches, worstTan);
+	failures += mismatches;
+	mismatches = checkRotation();
+	printf("Quaternion rotation mismatches : %d\n", mismatches);
+	failures += mismatches;
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+Checks getAngleVector against the rig built up from quaternions: the head is turned by the
+servo about x, and that turned by the platform about y, so the lamp straight ahead along z
+is brought into the head frame by the conjugate of platform * servo. Positive angles put the
+lamp towards +x and +y, so the platform turns by minus its angle.
+@param worstTan - receives how far the direction of two independent axes, (tan, tan, 1),
+is from the rig's at worst, in degrees
+@return - the number of angles whose directions differ
+*/
+static int checkRig(double *worstTan)
+{
+	const sun_vector_t lamp = { 0, 0, 1 };
+	sun_vector_t rig;
+	sun_vector_t vector;
+	anglef_t angle;
+	quat head;
+	double length;
+	double dot;
+	int servo;
+	int plat;
+	int mismatches = 0;
+
+	*worstTan = 0;
+	for (servo = -30; servo <= 30; servo++) {
+		for (plat = -30; plat <= 30; plat++) {
+			angle.alpha = servo;
+			angle.beta = plat;
+			getAngleVector(&angle, &vector);
+			head = getAxisQuat(0, 1, 0, -plat) * getAxisQuat(1, 0, 0, servo);
+			rig = rotateSunVector(head.conjugate(), lamp);
+			if (fabs(rig.x - vector.x) > QUATTOLERANCE || fabs(rig.y - vector.y) > QUATTOLERANCE || fabs(rig.z - vector.z) > QUATTOLERANCE)
+				mismatches++;
+			// The direction getAngleVector gave before it followed the rig's nesting
+			length = sqrt(tan(plat * M_PI / 180) * tan(plat * M_PI / 180) + tan(servo * M_PI / 180) * tan(servo * M_PI / 180) + 1);
+			dot = (tan(plat * M_PI / 180) * rig.x + tan(servo * M_PI / 180) * rig.y + rig.z) / length;
+			dot = dot > 1 ? 1 : dot;
+			if (acos(dot) * 180 / M_PI > *worstTan)
+				*worstTan = acos(dot) * 180 / M_PI;
+		}
+	}
+	return mismatches;
+}
+
+/*
+Checks the conversions and rotation of sun_quat.cpp: a vector must come back from its
+quaternion unchanged, and a quarter turn about z must take x to y
+@return - the number of results that differ
+*/
+static int checkRotation(void)
+{
+	const sun_vector_t vector = { 0.6, -0.48, 0.64 };
+	sun_vector_t back;
+	sun_vector_t turned;
+	int mismatches = 0;
+
+	back = getQuatSunVector(getSunQuat(vector));
+	if (back.x != vector.x || back.y != vector.y || back.z != vector.z)
+		mismatches++;
+	turned = rotateSunVector(getAxisQuat(0, 0, 1, 90), vector);
+	if (fabs(turned.x - 0.48) > QUATTOLERANCE || fabs(turned.y - 0.6) > QUATTOLERANCE || fabs(turned.z - 0.64) > QUATTOLERANCE)
+		mismatches++;
+	return mismatches;
+}
+
+/*
+Makes the unit quaternion of a turn about a unit axis
+@param x - the x component of the axis
+@param y - the y component of the axis
+@param z - the z component of the axis
+@param degrees - the angle of the turn, right handed
+@return - the quaternion
+*/
+static quat getAxisQuat(double x, double y, double z, double degrees)
+{
+	double half = degrees * M_PI / 360;
+
+	return quat(cos(half), sin(half) * x, sin(half) * y, sin(half) * z);
+}
@@ -0,0 +1,123 @@
+#include "tracker.h"
+
+static size_t searchNeighbourhood(const lookup_table_t *table, const voltage_t *norm, angle_t centre, int radius, float *bestDev);
+
+/*
+Sets up a tracker over a loaded table with no previous angle
+@param tracker - the tracker to set up
+@param table - the lookup table, must stay loaded while the tracker is used
+@param radius - half width of the neighbourhood searched, TRACKRADIUS is a good default
+@param threshold - deviation above which a global search is done, TRACKTHRESHOLD is a good default
+*/
+void initTracker(tracker_t *tracker, const lookup_table_t *table, int radius, float threshold) {
+	tracker->table = table;
+	tracker->radius = radius;
+	tracker->threshold = threshold;
+	resetTracker(tracker);
+}
+
+/*
+Forgets the last angle so the next reading is searched over the whole table
+@param tracker - the tracker
+*/
+void resetTracker(tracker_t *tracker) {
+	tracker->valid = 0;
+	tracker->last.alpha = 0;
+	tracker->last.beta = 0;
+}
+
+/*
+Finds the angle for a reading, searching near the last angle first
+@param tracker - the tracker
+@param realVolts - the voltage readings
+@param angle - receives the best angle, unchanged if nothing matched
+@return - the deviation of the best match, MAXVOLTDIFF if nothing matched or the reading is
+dark or not finite, which also forgets the last angle
+*/
+float trackAngles(tracker_t *tracker, const voltage_t *realVolts, angle_t *angle) {
+	const lookup_table_t *table = tracker->table;
+	voltage_t norm;
+	angle_t centre = tracker->last;
+	size_t row = table->count;
+	float best = MAXVOLTDIFF;
+	int step;
+
+	if (isBadReading(realVolts) || isDark(table, realVolts)) {
+		tracker->valid = 0;
+		return MAXVOLTDIFF;
+	}
+	normalizeVoltage(realVolts, &norm);
+	if (tracker->valid) {
+		// Walk the neighbourhood towards the best match until it is no longer on the edge
+		for (step = 0; step < TRACKSTEPS; step++) {
+			row = searchNeighbourhood(table, &norm, centre, tracker->radius, &best);
+			if (row >= table->count)
+				break;
+			if (abs(table->servo[row] - centre.alpha) < tracker->radius && abs(table->plat[row] - centre.beta) < tracker->radius)
+				break;
+			centre.alpha = table->servo[row];
+			centre.beta = table->plat[row];
+		}
+	}
+	if (row >= table->count || best > tracker->threshold) {
+		row = findBestMatch(table, &norm, &best);
+	}
+	if (row >= table->count) {
+		tracker->valid = 0;
+		return MAXVOLTDIFF;
+	}
+	angle->alpha = tracker->last.alpha = table->servo[row];
+	angle->beta = tracker->last.beta = table->plat[row];
+	tracker->valid = 1;
+	return best;
+}
+
+/*
+Searches the grid cells within a radius of an angle
+@param table - the lookup table
+@param norm - the normalized voltage reading
+@param centre - the angle at the middle of the neighbourhood
+@param radius - half width of the neighbourhood
+@param bestDev - receives the lowest deviation found
+@return - the index of the best row, or table->count if no row is under MAXVOLTDIFF
+*/
+static size_t searchNeighbourhood(const lookup_table_t *table, const voltage_t *norm, angle_t centre, int radius, float *bestDev) {
+	float best = MAXVOLTDIFF;
+	float current;
+	size_t bestRow = table->count;
+	int servoLow = centre.alpha - radius - table->servoMin;
+	int servoHigh = centre.alpha + radius - table->servoMin;
+	int platLow = centre.beta - radius - table->platMin;
+	int platHigh = centre.beta + radius - table->platMin;
+	int servo;
+	int plat;
+	int row;
+
+	// Clip the neighbourhood to the grid so the cells can be read directly
+	if (servoLow < 0)
+		servoLow = 0;
+	if (servoHigh >= table->servoCount)
+		servoHigh = table->servoCount - 1;
+	if (platLow < 0)
+		platLow = 0;
+	if (platHigh >= table->platCount)
+		platHigh = table->platCount - 1;
+	for (plat = platLow; plat <= platHigh; plat++) {
+		for (servo = servoLow; servo <= servoHigh; servo++) {
+			row = table->grid[plat * table->servoCount + servo];
+			if (row < 0)
+				continue;
+			current =
+				fabsf(table->volt1[row] - norm->volt1) +
+				fabsf(table->volt2[row] - norm->volt2) +
+				fabsf(table->volt3[row] - norm->volt3) +
+				fabsf(table->volt4[row] - norm->volt4);
+			if (current < best || (current == best && (size_t)row < bestRow)) {
+				best = current;
+				bestRow = row;
+			}
+		}
+	}
+	*bestDev = best;
+	return bestRow;
+}
@@ -0,0 +1,28 @@
+#ifndef TRACKER_H
+#define TRACKER_H
+
+#include "calculations.h"
+
+// Half width of the grid neighbourhood searched around the last angle
+#define TRACKRADIUS 2
+// Deviation above which the local match is not trusted and the whole table is searched
+#define TRACKTHRESHOLD 0.05f
+// Times the neighbourhood may be recentred when the best match sits on its edge
+#define TRACKSTEPS 4
+
+// Follows the sun from one reading to the next, starting each search at the last angle
+typedef struct tracker_s {
+	const lookup_table_t *table;
+	angle_t last;
+	int valid;
+	int radius;
+	float threshold;
+} tracker_t;
+
+void initTracker(tracker_t *tracker, const lookup_table_t *table, int radius, float threshold);
+
+void resetTracker(tracker_t *tracker);
+
+float trackAngles(tracker_t *tracker, const voltage_t *realVolts, angle_t *angle);
+
+#endif